@@ -0,0 +1,846 @@
+#include <CLI/CLI.hpp>
+
+#include <fmt/format.h>
+
+#include <glslang/Public/ShaderLang.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <latch>
+#include <map>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "builtins.hpp"
+#include "document.hpp"
+#include "infolog.hpp"
+#include "lineindex.hpp"
+#include "messagebuffer.hpp"
+#include "occurrences.hpp"
+#include "scan.hpp"
+#include "scheduler.hpp"
+#include "server.hpp"
+#include "symbols.hpp"
+#include "utils.hpp"
+
+#ifndef GLSLLS_BENCH_CORPUS
+#define GLSLLS_BENCH_CORPUS "bench/corpus"
+#endif
+
+/// The number of heap allocations made so far, counted by the replacement
+/// `operator new` below.
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+/// Prevents the compiler from optimizing away a result.
+template <typename T>
+static void keep(const T& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    size_t iterations;
+    double mean_ns;
+    double median_ns;
+    double min_ns;
+    /// Bytes processed per iteration, or zero if throughput does not apply.
+    size_t bytes;
+    double allocations;
+};
+
+class BenchSuite {
+public:
+    BenchSuite(std::string filter, FILE* output) : m_filter(std::move(filter)), m_output(output) {}
+
+    /// Times `f`, which performs one iteration. The iterations are grouped into
+    /// batches of at least a millisecond, and the statistics are computed over
+    /// the per-iteration times of the batches. Heap allocations are counted
+    /// over a separate, untimed batch.
+    template <typename F>
+    void run(const std::string& name, size_t bytes, F&& f)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos) return;
+
+        using clock = std::chrono::steady_clock;
+        auto time_batch = [&](size_t batch_size) {
+            auto start = clock::now();
+            for (size_t i = 0; i < batch_size; i++) f();
+            return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        };
+
+        size_t batch_size = 1;
+        while (time_batch(batch_size) < 1e6 && batch_size < (1u << 20)) {
+            batch_size *= 2;
+        }
+
+        const size_t batch_count = 10;
+        std::vector<double> samples;
+        for (size_t i = 0; i < batch_count; i++) {
+            samples.push_back(time_batch(batch_size) / batch_size);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        size_t allocation_iterations = std::min<size_t>(batch_size, 16);
+        size_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < allocation_iterations; i++) f();
+        size_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+
+        BenchResult result;
+        result.name = name;
+        result.iterations = batch_size * batch_count;
+        result.mean_ns = 0;
+        for (double sample : samples) result.mean_ns += sample / samples.size();
+        result.median_ns = samples[samples.size() / 2];
+        result.min_ns = samples.front();
+        result.bytes = bytes;
+        result.allocations = double(allocations) / allocation_iterations;
+
+        std::string throughput;
+        if (bytes > 0) {
+            throughput = fmt::format("{:>10.1f} MB/s", bytes / result.median_ns * 1e9 / (1024 * 1024));
+        }
+        fmt::print(m_output, "{:<36} {:>9} iterations {:>14.0f} ns/iter {:>10.1f} allocs/iter {}\n",
+                name, result.iterations, result.median_ns, result.allocations, throughput);
+        std::fflush(m_output);
+        m_results.push_back(std::move(result));
+    }
+
+    /// Runs a self-check unless it is filtered out, like a benchmark. `f`
+    /// returns a description of what went wrong, or an empty string if the
+    /// check passed. Checks are named `check/<name>`, so that
+    /// `--filter check/` runs only them.
+    template <typename F>
+    void check(const std::string& name, F&& f)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos) return;
+
+        std::string failure = f();
+        fmt::print(m_output, "{:<36} {}\n", name, failure.empty() ? "ok" : "FAILED: " + failure);
+        std::fflush(m_output);
+        if (!failure.empty()) m_failed = true;
+    }
+
+    /// Whether any check failed.
+    bool failed() const { return m_failed; }
+
+    json to_json() const
+    {
+        json benchmarks = json::array();
+        for (const auto& result : m_results) {
+            json entry{
+                { "name", result.name },
+                { "iterations", result.iterations },
+                { "mean_ns", result.mean_ns },
+                { "median_ns", result.median_ns },
+                { "min_ns", result.min_ns },
+                { "allocations_per_iteration", result.allocations },
+            };
+            if (result.bytes > 0) {
+                entry["bytes_per_iteration"] = result.bytes;
+            }
+            benchmarks.push_back(std::move(entry));
+        }
+        return json{ { "benchmarks", std::move(benchmarks) } };
+    }
+
+private:
+    std::string m_filter;
+    FILE* m_output;
+    std::vector<BenchResult> m_results;
+    bool m_failed = false;
+};
+
+/// Builds a stream of `count` didChange notifications, each carrying a
+/// document of `text_size` bytes, framed as they would arrive on stdin.
+static std::string make_input(size_t count, size_t text_size)
+{
+    std::string text;
+    while (text.size() < text_size) {
+        text += "vec4 color = texture(sampler, uv) * vec4(1.0, 0.5, 0.25, 1.0);\n";
+    }
+    text.resize(text_size);
+
+    std::string input;
+    for (size_t i = 0; i < count; i++) {
+        json body{
+            { "jsonrpc", "2.0" },
+            { "method", "textDocument/didChange" },
+            { "params", {
+                { "textDocument", { { "uri", "file:///bench.frag" }, { "version", i } } },
+                { "contentChanges", { { { "text", text } } } },
+            } },
+        };
+        std::string content = body.dump();
+        input += "Content-Length: " + std::to_string(content.size()) + "\r\n";
+        input += "Content-Type: application/vscode-jsonrpc;charset=utf-8\r\n\r\n";
+        input += content;
+    }
+    return input;
+}
+
+/// Feeds `input` through a MessageBuffer in reads of `chunk_size` bytes, like
+/// the stdin transport does.
+static void bench_framing(BenchSuite& suite, const char* name, size_t count, size_t text_size, size_t chunk_size)
+{
+    std::string input = make_input(count, text_size);
+    MessageBuffer message_buffer;
+    suite.run(name, input.size(), [&] {
+        for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+            const char* data = input.data() + offset;
+            size_t remaining = std::min(chunk_size, input.size() - offset);
+            while (remaining > 0) {
+                size_t consumed = message_buffer.handle_data(data, remaining);
+                data += consumed;
+                remaining -= consumed;
+                if (message_buffer.message_completed()) {
+                    keep(message_buffer.body());
+                    message_buffer.clear();
+                }
+            }
+        }
+    });
+}
+
+static void bench_make_response(BenchSuite& suite)
+{
+    json items = json::array();
+    for (int i = 0; i < 100; i++) {
+        items.push_back(json{
+            { "label", fmt::format("distribution_ggx{}", i) },
+            { "kind", 3 },
+            { "detail", "float (vec3 normal, vec3 halfway, float roughness)" },
+            { "sortText", fmt::format("{:05}", i) },
+        });
+    }
+    json completion{
+        { "id", 42 },
+        { "result", { { "isIncomplete", true }, { "items", items } } },
+    };
+
+    std::string buffer;
+    size_t size = make_response(completion, buffer, false).size();
+    suite.run("make_response/completion-100", size, [&] {
+        keep(make_response(completion, buffer, false));
+    });
+    size = make_response(completion, buffer, true).size();
+    suite.run("make_response/completion-100-pretty", size, [&] {
+        keep(make_response(completion, buffer, true));
+    });
+}
+
+/// Renames the given identifiers in `text` by appending `suffix` to them.
+static std::string rename_identifiers(const std::string& text, const std::vector<std::string>& names,
+        const std::string& suffix)
+{
+    std::string result;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!is_identifier_start_char(text[i])) {
+            result += text[i++];
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && is_identifier_char(text[i])) i++;
+        std::string word = text.substr(start, i - start);
+        result += word;
+        if (std::find(names.begin(), names.end(), word) != names.end()) {
+            result += suffix;
+        }
+    }
+    return result;
+}
+
+/// Builds a valid fragment shader of at least `size` bytes out of renamed
+/// copies of the lighting helpers.
+static std::string make_huge_shader(const std::string& helpers, size_t size)
+{
+    std::vector<std::string> names = {
+        "PI", "MAX_LIGHTS", "Light", "distribution_ggx", "geometry_schlick_ggx",
+        "geometry_smith", "fresnel_schlick", "attenuation",
+    };
+    std::string text = "#version 460\n";
+    for (int i = 0; text.size() < size; i++) {
+        text += rename_identifiers(helpers, names, fmt::format("_{}", i));
+    }
+    text += "void main() {}\n";
+    return text;
+}
+
+static std::string read_corpus_file(const std::string& corpus, const char* name)
+{
+    std::string path = corpus + "/" + name;
+    auto contents = read_file_to_string(path.c_str());
+    if (!contents) {
+        fmt::print(stderr, "error: could not read {}\n", path);
+        std::exit(1);
+    }
+    return *contents;
+}
+
+/// Compares the info log parser against the messages the `std::regex` based
+/// parser it replaced found in the same log.
+static std::string check_info_log(const std::string& corpus)
+{
+    std::string log = read_corpus_file(corpus, "infolog/messages.log");
+    json expected = json::parse(read_corpus_file(corpus, "infolog/messages.expected.json"));
+
+    json messages = json::array();
+    for_each_info_log_message(log, [&](const InfoLogMessage& message) {
+        auto identifier = find_message_identifier(message.message);
+        messages.push_back(json{
+            { "severity", message.severity },
+            { "file", message.file },
+            { "line", message.line },
+            { "message", message.message },
+            { "identifier", identifier ? json(*identifier) : json(nullptr) },
+        });
+    });
+
+    for (size_t i = 0; i < std::max(messages.size(), expected.size()); i++) {
+        json actual = i < messages.size() ? messages[i] : json(nullptr);
+        json wanted = i < expected.size() ? expected[i] : json(nullptr);
+        if (actual != wanted) {
+            return fmt::format("message {}: expected {}, got {}", i, wanted.dump(), actual.dump());
+        }
+    }
+    return "";
+}
+
+/// Finds the identifiers outside of comments and strings one byte at a time,
+/// the way `OccurrenceIndex` did before it used `TextScanner`.
+static std::map<std::string, std::vector<uint32_t>> find_occurrences_bytewise(const std::string& text)
+{
+    std::map<std::string, std::vector<uint32_t>> occurrences;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            size_t end = text.find('\n', i);
+            i = end == std::string::npos ? text.size() : end;
+        } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+            size_t end = text.find("*/", i + 2);
+            i = end == std::string::npos ? text.size() : end + 2;
+        } else if (c == '"') {
+            size_t end = text.find_first_of("\"\n", i + 1);
+            i = end == std::string::npos ? text.size() : end + 1;
+        } else if ('0' <= c && c <= '9') {
+            i++;
+            while (i < text.size() && is_identifier_char(text[i])) i++;
+        } else if (is_identifier_start_char(c)) {
+            size_t start = i;
+            while (i < text.size() && is_identifier_char(text[i])) i++;
+            occurrences[text.substr(start, i - start)].push_back(start);
+        } else {
+            i++;
+        }
+    }
+    return occurrences;
+}
+
+/// Describes the symbols `extract_symbols` finds in `text` at the current
+/// scan level, so that the levels can be compared.
+static std::string describe_symbols(const std::string& text)
+{
+    SymbolTable symbols;
+    extract_symbols(text.c_str(), symbols);
+    std::string description;
+    for (const auto& entry : symbols) {
+        description += fmt::format("{} {} {} {}\n", entry.name, int(entry.symbol.kind), entry.symbol.details,
+                entry.symbol.location.offset);
+    }
+    return description;
+}
+
+/// Compares `extract_symbols` at every scan level against the scalar level,
+/// and `OccurrenceIndex` at every level against a byte-at-a-time scan. The
+/// inputs are the corpus, prefixes of it that end inside a block, and random
+/// text made of the characters the classifier distinguishes.
+static std::string check_scan_levels(const std::vector<std::string>& corpus)
+{
+    std::vector<std::string> inputs = corpus;
+    for (const auto& text : corpus) {
+        for (size_t size : { 1, 63, 64, 65, 127, 200, 1000 }) {
+            if (size < text.size()) inputs.push_back(text.substr(0, size));
+        }
+    }
+    std::mt19937 random(42);
+    const std::string alphabet = "abcXYZ_019 \t\n{}();=,.*/\"#+-";
+    for (size_t size = 0; size < 300; size++) {
+        std::string text;
+        for (size_t i = 0; i < size; i++) {
+            text += alphabet[random() % alphabet.size()];
+        }
+        inputs.push_back(std::move(text));
+    }
+
+    std::vector<std::string> expected_symbols;
+    set_scan_level(ScanLevel::Scalar);
+    for (const auto& text : inputs) {
+        expected_symbols.push_back(describe_symbols(text));
+    }
+
+    std::string failure;
+    for (int level = 0; failure.empty() && level <= int(best_scan_level()); level++) {
+        set_scan_level(ScanLevel(level));
+        const char* level_name = get_scan_level_name(ScanLevel(level));
+        for (size_t i = 0; failure.empty() && i < inputs.size(); i++) {
+            if (describe_symbols(inputs[i]) != expected_symbols[i]) {
+                failure = fmt::format("symbols of input {} differ at level {}", i, level_name);
+            }
+
+            OccurrenceIndex occurrences(inputs[i]);
+            for (const auto& [name, offsets] : find_occurrences_bytewise(inputs[i])) {
+                auto found = occurrences.find(name);
+                if (!std::equal(found.begin(), found.end(), offsets.begin(), offsets.end())) {
+                    failure = fmt::format("occurrences of '{}' in input {} differ at level {}", name, i, level_name);
+                    break;
+                }
+            }
+        }
+    }
+    set_scan_level(best_scan_level());
+    return failure;
+}
+
+/// Applies random ranged edits, with characters of every UTF-8 length
+/// including ones that take a UTF-16 surrogate pair, both to a `Document` and
+/// to a plain string, and compares the two. The text spans several rope
+/// chunks, so that characters get split between them.
+static std::string check_document_edits()
+{
+    const std::vector<std::string> pieces = { "a", "_", " ", "\n", "float x;\n", "é", "€", "𝄞" };
+    std::mt19937 random(42);
+    auto random_text = [&] {
+        std::string text;
+        for (size_t count = random() % 8; count > 0; count--) {
+            text += pieces[random() % pieces.size()];
+        }
+        return text;
+    };
+
+    // Where each character of the reference starts, counted the way the
+    // client counts: in lines, and in UTF-16 code units within a line.
+    struct Position {
+        size_t offset;
+        SourceFileLocation location;
+    };
+    auto find_positions = [](const std::string& text) {
+        std::vector<Position> positions;
+        SourceFileLocation location{ 0, 0 };
+        size_t offset = 0;
+        while (true) {
+            positions.push_back({ offset, location });
+            if (offset == text.size()) break;
+            size_t start = offset;
+            do {
+                offset++;
+            } while (offset < text.size() && (text[offset] & 0xc0) == 0x80);
+            if (text[start] == '\n') {
+                location = { location.line + 1, 0 };
+            } else {
+                location.character += offset - start == 4 ? 2 : 1;
+            }
+        }
+        return positions;
+    };
+
+    std::string expected;
+    while (expected.size() < 2048) {
+        expected += random_text();
+    }
+    Document document(expected);
+    for (int edit = 0; edit < 4000; edit++) {
+        auto positions = find_positions(expected);
+        size_t first = random() % positions.size();
+        size_t last = std::min(positions.size() - 1, first + random() % 16);
+        // Columns past the end of a line stop at the line break.
+        if (random() % 8 == 0) {
+            while (last + 1 < positions.size() && positions[last + 1].location.line == positions[last].location.line) {
+                last++;
+            }
+            positions[last].location.character += 1 + random() % 4;
+        }
+        Position start = positions[first];
+        Position end = positions[last];
+
+        std::string text = random_text();
+        document.replace(start.location, end.location, text);
+        expected.replace(start.offset, end.offset - start.offset, text);
+        if (document.text() != expected) {
+            return fmt::format("the text differs after edit {}", edit);
+        }
+    }
+    return "";
+}
+
+/// Collects the responses a `RequestScheduler` writes, in order.
+class WrittenResponses {
+public:
+    RequestScheduler::Write writer()
+    {
+        return [this](json response) {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (!m_ids.empty()) m_ids += " ";
+            m_ids += response.value("id", json()).dump();
+            m_responses.push_back(std::move(response));
+            m_written.notify_all();
+        };
+    }
+
+    /// Waits until `count` responses were written, giving up after a while
+    /// so that a scheduler that holds a response back fails the check.
+    bool wait_for(size_t count)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        return m_written.wait_for(lock, std::chrono::seconds(10), [&] { return m_responses.size() >= count; });
+    }
+
+    /// The ids of the responses, separated by spaces.
+    std::string ids()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_ids;
+    }
+
+    json at(size_t index)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_responses.at(index);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_written;
+    std::vector<json> m_responses;
+    std::string m_ids;
+};
+
+/// Opens latches when it goes out of scope, so that a failed check does not
+/// leave the scheduler waiting for blocked handlers.
+struct LatchOpener {
+    std::vector<std::latch*> latches;
+
+    ~LatchOpener()
+    {
+        for (std::latch* latch : latches) {
+            if (!latch->try_wait()) latch->count_down();
+        }
+    }
+};
+
+/// Checks the order in which `RequestScheduler` writes responses. Handlers
+/// block on latches, so that the order in which they finish is fixed.
+static std::string check_scheduler()
+{
+    using Priority = RequestScheduler::Priority;
+    auto respond_with = [](const char* id) {
+        return [id](const CancellationToken&) -> std::optional<json> { return json{ { "id", id }, { "result", nullptr } }; };
+    };
+
+    {
+        // Interactive responses pass background ones, but neither other
+        // interactive responses nor the ones given to `respond`.
+        WrittenResponses written;
+        std::latch release_background(1);
+        std::latch release_interactive(1);
+        std::latch interactive_done(1);
+        RequestScheduler scheduler(3, written.writer());
+        LatchOpener opener{ { &release_background, &release_interactive } };
+        scheduler.submit(Priority::Background, "background", [&](const CancellationToken&) -> std::optional<json> {
+            release_background.wait();
+            return json{ { "id", "background" }, { "result", nullptr } };
+        });
+        scheduler.submit(Priority::Interactive, "first", respond_with("first"));
+        if (!written.wait_for(1)) return "the interactive response waited for the background one";
+        scheduler.submit(Priority::Interactive, "slow", [&](const CancellationToken&) -> std::optional<json> {
+            release_interactive.wait();
+            return json{ { "id", "slow" }, { "result", nullptr } };
+        });
+        scheduler.submit(Priority::Interactive, "fast", [&](const CancellationToken&) -> std::optional<json> {
+            interactive_done.count_down();
+            return json{ { "id", "fast" }, { "result", nullptr } };
+        });
+        scheduler.respond(json{ { "id", "direct" }, { "result", nullptr } });
+        scheduler.submit(Priority::Interactive, "last", respond_with("last"));
+
+        interactive_done.wait();
+        release_interactive.count_down();
+        if (!written.wait_for(3)) return fmt::format("only {} were written", written.ids());
+        release_background.count_down();
+        if (!written.wait_for(6)) return fmt::format("only {} were written", written.ids());
+
+        std::string expected = R"("first" "slow" "fast" "background" "direct" "last")";
+        if (written.ids() != expected) return fmt::format("wrote {}, not {}", written.ids(), expected);
+    }
+
+    {
+        // A cancelled request that has not started is answered at once, but
+        // its response keeps its place among the others.
+        WrittenResponses written;
+        std::latch release(1);
+        std::atomic<bool> cancelled_ran{false};
+        RequestScheduler scheduler(1, written.writer());
+        LatchOpener opener{ { &release } };
+        scheduler.submit(Priority::Interactive, "running", [&](const CancellationToken&) -> std::optional<json> {
+            release.wait();
+            return json{ { "id", "running" }, { "result", nullptr } };
+        });
+        scheduler.submit(Priority::Interactive, "cancelled", [&](const CancellationToken&) -> std::optional<json> {
+            cancelled_ran = true;
+            return json{ { "id", "cancelled" }, { "result", nullptr } };
+        });
+        scheduler.submit(Priority::Interactive, "queued", respond_with("queued"));
+        scheduler.cancel("cancelled");
+        release.count_down();
+        if (!written.wait_for(3)) return fmt::format("only {} were written", written.ids());
+
+        std::string expected = R"("running" "cancelled" "queued")";
+        if (written.ids() != expected) return fmt::format("wrote {}, not {}", written.ids(), expected);
+        if (cancelled_ran) return "the cancelled request was run";
+        if (written.at(1).value("/error/code"_json_pointer, 0) != -32800) {
+            return fmt::format("the cancelled request was answered with {}", written.at(1).dump());
+        }
+    }
+    return "";
+}
+
+#ifdef HAVE_PARSED_SYMBOLS
+/// Checks the symbols taken from the syntax tree of `symbols.frag` for the
+/// declarations the text scan does not handle well: struct and block members,
+/// overloads, anonymous blocks, locals without an initializer and
+/// declarations in included files.
+static std::string check_parsed_symbols(const std::string& corpus, AppState& appstate)
+{
+    struct Expected {
+        const char* name;
+        Symbol::Kind kind;
+        /// The corpus file declaring the symbol.
+        const char* file;
+        /// The text of the declaration, ending with the name.
+        const char* declaration;
+    };
+    const Expected expected_symbols[] = {
+        { "Light", Symbol::Type, "lighting.glsl", "struct Light" },
+        // Also used by exposure.glsl, which sorts first but is included later.
+        { "PI", Symbol::Constant, "lighting.glsl", "const float PI" },
+        { "exposure_scale", Symbol::Function, "exposure.glsl", "float exposure_scale" },
+        { "position", Symbol::Constant, "lighting.glsl", "vec3 position" },
+        { "distribution_ggx", Symbol::Function, "lighting.glsl", "float distribution_ggx" },
+        { "Material", Symbol::Type, "symbols.frag", "struct Material" },
+        { "base_color", Symbol::Constant, "symbols.frag", "vec3 base_color" },
+        { "time", Symbol::Constant, "symbols.frag", "float time" },
+        { "resolution", Symbol::Constant, "symbols.frag", "vec2 resolution" },
+        { "default_material", Symbol::Constant, "symbols.frag", "Material default_material" },
+        { "blend", Symbol::Function, "symbols.frag", "float blend" },
+        { "pulse", Symbol::Constant, "symbols.frag", "float pulse" },
+        { "tint", Symbol::Constant, "symbols.frag", "vec3 tint" },
+    };
+
+    std::string uri = make_path_uri(corpus + "/symbols.frag");
+    Document document(read_corpus_file(corpus, "symbols.frag"));
+    get_diagnostics(uri, document, appstate);
+    auto symbols = document.parsed_symbols();
+    if (!symbols) return "symbols.frag was not parsed";
+
+    for (const Expected& expected : expected_symbols) {
+        const Symbol* symbol = symbols->find(expected.name);
+        if (!symbol) return fmt::format("{} is missing", expected.name);
+        if (symbol->kind != expected.kind) {
+            return fmt::format("{} is of kind {}, not {}", expected.name, int(symbol->kind), int(expected.kind));
+        }
+
+        std::string text = read_corpus_file(corpus, expected.file);
+        std::string_view declaration = expected.declaration;
+        int offset = int(text.find(declaration) + declaration.size() - std::string_view(expected.name).size());
+        std::string_view symbol_uri = symbol->location.has_uri() ? get_uri(symbol->location.uri) : "";
+        if (!symbol_uri.ends_with(std::string("/") + expected.file) || symbol->location.offset != offset) {
+            return fmt::format("{} is located at {}:{}, not {}:{}", expected.name, symbol_uri,
+                    symbol->location.offset, expected.file, offset);
+        }
+    }
+
+    // Overloads share one symbol, listing each signature on its own line.
+    const Symbol* blend = symbols->find("blend");
+    if (blend->details.find("float from") == std::string_view::npos
+            || blend->details.find("vec3 from") == std::string_view::npos) {
+        return fmt::format("blend lists '{}', not both overloads", blend->details);
+    }
+    return "";
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    CLI::App app{ "Microbenchmarks for the GLSL language server" };
+
+    std::string corpus = GLSLLS_BENCH_CORPUS;
+    std::string json_path;
+    std::string filter;
+    app.add_option("--corpus", corpus, "Directory with the shaders to benchmark against");
+    app.add_option("--json", json_path, "Write the results as JSON to the given file, or '-' for stdout");
+    app.add_option("--filter", filter, "Only run benchmarks whose name contains this string");
+    try {
+        app.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        return app.exit(e);
+    }
+
+    glslang::InitializeProcess();
+
+    AppState appstate;
+    appstate.verbose = false;
+    appstate.use_logfile = false;
+    appstate.max_completions = 100;
+    appstate.pretty_print = false;
+    appstate.target.options = EShMessages(EShMsgSpvRules | EShMsgVulkanRules);
+
+    std::string small = read_corpus_file(corpus, "fullscreen.vert");
+    std::string pbr = read_corpus_file(corpus, "pbr.frag");
+    std::string helpers = read_corpus_file(corpus, "lighting.glsl");
+    std::string huge = make_huge_shader(helpers, 256 * 1024);
+
+    std::string small_uri = make_path_uri(corpus + "/fullscreen.vert");
+    std::string pbr_uri = make_path_uri(corpus + "/pbr.frag");
+    std::string huge_uri = make_path_uri(corpus + "/huge.frag");
+    appstate.workspace.add_document(small_uri, small);
+    appstate.workspace.add_document(pbr_uri, pbr);
+    appstate.workspace.add_document(huge_uri, huge);
+
+    // When JSON goes to stdout, keep the table out of it.
+    BenchSuite suite(filter, json_path == "-" ? stderr : stdout);
+
+    suite.check("check/info-log", [&] { return check_info_log(corpus); });
+    suite.check("check/scan-levels", [&] { return check_scan_levels({ small, pbr, helpers, huge }); });
+    suite.check("check/document-edits", [&] { return check_document_edits(); });
+    suite.check("check/scheduler", [&] { return check_scheduler(); });
+#ifdef HAVE_PARSED_SYMBOLS
+    suite.check("check/parsed-symbols", [&] { return check_parsed_symbols(corpus, appstate); });
+#endif
+
+    bench_framing(suite, "framing/small-messages", 2000, 256, 64 * 1024);
+    bench_framing(suite, "framing/large-messages", 4, 1024 * 1024, 64 * 1024);
+    bench_framing(suite, "framing/bytewise", 20, 4096, 1);
+
+    bench_make_response(suite);
+
+    suite.run("extract_symbols/pbr", pbr.size(), [&] {
+        SymbolTable symbols;
+        extract_symbols(pbr.c_str(), symbols);
+        keep(symbols);
+    });
+    suite.run("extract_symbols/huge", huge.size(), [&] {
+        SymbolTable symbols;
+        extract_symbols(huge.c_str(), symbols);
+        keep(symbols);
+    });
+
+    // Compare the text classifiers on the large input, from the scalar
+    // fallback up to the best one the CPU supports.
+    for (int level = 0; level <= int(best_scan_level()); level++) {
+        set_scan_level(ScanLevel(level));
+        const char* level_name = get_scan_level_name(ScanLevel(level));
+        suite.run(fmt::format("extract_symbols/huge-{}", level_name), huge.size(), [&] {
+            SymbolTable symbols;
+            extract_symbols(huge.c_str(), symbols);
+            keep(symbols);
+        });
+        suite.run(fmt::format("occurrences/huge-{}", level_name), huge.size(), [&] {
+            keep(OccurrenceIndex(huge));
+        });
+    }
+    set_scan_level(best_scan_level());
+
+    suite.run("add_builtin_types", 0, [&] {
+        SymbolTable symbols;
+        add_builtin_types(symbols);
+        keep(symbols);
+    });
+
+    suite.run("get_symbols/cold-builtins", 0, [&] {
+        clear_builtin_symbols();
+        keep(get_symbols(pbr_uri, *appstate.workspace.snapshot(), appstate));
+    });
+    suite.run("get_symbols/warm-builtins", 0, [&] {
+        keep(get_symbols(pbr_uri, *appstate.workspace.snapshot(), appstate));
+    });
+
+    // Measure the parses themselves, not lookups of their results.
+    appstate.analysis_cache.set_budget(0);
+    Document small_document(small);
+    Document pbr_document(pbr);
+    Document huge_document(huge);
+    suite.run("get_diagnostics/small", small.size(), [&] {
+        keep(get_diagnostics(small_uri, small_document, appstate));
+    });
+    suite.run("get_diagnostics/pbr-with-include", pbr.size(), [&] {
+        keep(get_diagnostics(pbr_uri, pbr_document, appstate));
+    });
+    suite.run("get_diagnostics/huge", huge.size(), [&] {
+        keep(get_diagnostics(huge_uri, huge_document, appstate));
+    });
+
+#ifdef HAVE_PARSED_SYMBOLS
+    // Once a version has been parsed, its symbols come from the syntax tree.
+    get_diagnostics(pbr_uri, *appstate.workspace.get_document(pbr_uri), appstate);
+    suite.run("get_symbols/parsed", 0, [&] {
+        keep(get_symbols(pbr_uri, *appstate.workspace.snapshot(), appstate));
+    });
+#endif
+
+    appstate.analysis_cache.set_budget(AnalysisCache::DEFAULT_BUDGET);
+    suite.run("get_diagnostics/pbr-cached", pbr.size(), [&] {
+        keep(get_diagnostics(pbr_uri, pbr_document, appstate));
+    });
+
+    // Positions are converted with a line index (or, for edits, by walking
+    // the rope), which replaced the linear `find_position_offset`.
+    int huge_lines = LineIndex(huge).line_count();
+    suite.run("position/line-index-build", huge.size(), [&] {
+        keep(LineIndex(huge));
+    });
+    LineIndex huge_index(huge);
+    suite.run("position/line-index-offset", 0, [&] {
+        for (int line = 0; line < huge_lines; line += 97) keep(huge_index.offset(line, 12));
+    });
+    suite.run("position/document-offset-at", 0, [&] {
+        for (int line = 0; line < huge_lines; line += 97) keep(huge_document.offset_at(line, 12));
+    });
+
+    if (!json_path.empty()) {
+        std::string output = suite.to_json().dump(4);
+        if (json_path == "-") {
+            fmt::print("{}\n", output);
+        } else {
+            std::ofstream(json_path) << output << "\n";
+        }
+    }
+
+    glslang::FinalizeProcess();
+    return suite.failed() ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+// Uses a constant of lighting.glsl, which is included before this file.
+
+float exposure_scale(float stops)
+{
+    return exp2(stops) / PI;
+}
@@ -0,0 +1,46 @@
+// Shared lighting helpers for the benchmark corpus.
+
+const float PI = 3.14159265359;
+const int MAX_LIGHTS = 16;
+
+struct Light {
+    vec3 position;
+    float radius;
+    vec3 color;
+    float intensity;
+};
+
+float distribution_ggx(vec3 normal, vec3 halfway, float roughness)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float n_dot_h = max(dot(normal, halfway), 0.0);
+    float denominator = n_dot_h * n_dot_h * (a2 - 1.0) + 1.0;
+    return a2 / (PI * denominator * denominator);
+}
+
+float geometry_schlick_ggx(float n_dot_v, float roughness)
+{
+    float r = roughness + 1.0;
+    float k = (r * r) / 8.0;
+    return n_dot_v / (n_dot_v * (1.0 - k) + k);
+}
+
+float geometry_smith(vec3 normal, vec3 view, vec3 light, float roughness)
+{
+    float n_dot_v = max(dot(normal, view), 0.0);
+    float n_dot_l = max(dot(normal, light), 0.0);
+    return geometry_schlick_ggx(n_dot_v, roughness) * geometry_schlick_ggx(n_dot_l, roughness);
+}
+
+vec3 fresnel_schlick(float cos_theta, vec3 f0)
+{
+    return f0 + (1.0 - f0) * pow(clamp(1.0 - cos_theta, 0.0, 1.0), 5.0);
+}
+
+float attenuation(Light light, vec3 world_position)
+{
+    float distance = length(light.position - world_position);
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    return falloff * falloff / (distance * distance + 1.0);
+}
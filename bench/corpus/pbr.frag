@@ -0,0 +1,85 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "lighting.glsl"
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+layout(location = 3) in vec4 in_tangent;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 eye;
+    float exposure;
+} camera;
+
+layout(set = 0, binding = 1) uniform Lights {
+    Light lights[MAX_LIGHTS];
+    int light_count;
+} scene;
+
+layout(set = 1, binding = 0) uniform sampler2D albedo_map;
+layout(set = 1, binding = 1) uniform sampler2D normal_map;
+layout(set = 1, binding = 2) uniform sampler2D metallic_roughness_map;
+layout(set = 1, binding = 3) uniform sampler2D occlusion_map;
+layout(set = 1, binding = 4) uniform samplerCube irradiance_map;
+
+vec3 get_normal()
+{
+    vec3 tangent_normal = texture(normal_map, in_uv).xyz * 2.0 - 1.0;
+    vec3 n = normalize(in_normal);
+    vec3 t = normalize(in_tangent.xyz);
+    vec3 b = cross(n, t) * in_tangent.w;
+    return normalize(mat3(t, b, n) * tangent_normal);
+}
+
+vec3 tonemap_aces(vec3 color)
+{
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    return clamp((color * (a * color + b)) / (color * (c * color + d) + e), 0.0, 1.0);
+}
+
+vec3 shade_light(Light light, vec3 normal, vec3 view, vec3 albedo, float metallic, float roughness)
+{
+    vec3 to_light = normalize(light.position - in_position);
+    vec3 halfway = normalize(view + to_light);
+
+    vec3 f0 = mix(vec3(0.04), albedo, metallic);
+    float ndf = distribution_ggx(normal, halfway, roughness);
+    float g = geometry_smith(normal, view, to_light, roughness);
+    vec3 f = fresnel_schlick(max(dot(halfway, view), 0.0), f0);
+
+    vec3 specular = ndf * g * f / (4.0 * max(dot(normal, view), 0.0) * max(dot(normal, to_light), 0.0) + 0.0001);
+    vec3 diffuse = (vec3(1.0) - f) * (1.0 - metallic);
+
+    float n_dot_l = max(dot(normal, to_light), 0.0);
+    vec3 radiance = light.color * light.intensity * attenuation(light, in_position);
+    return (diffuse * albedo / PI + specular) * radiance * n_dot_l;
+}
+
+void main()
+{
+    vec4 albedo = texture(albedo_map, in_uv);
+    vec2 metallic_roughness = texture(metallic_roughness_map, in_uv).bg;
+    float occlusion = texture(occlusion_map, in_uv).r;
+
+    vec3 normal = get_normal();
+    vec3 view = normalize(camera.eye - in_position);
+
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < scene.light_count; i++) {
+        color += shade_light(scene.lights[i], normal, view, albedo.rgb, metallic_roughness.x, metallic_roughness.y);
+    }
+
+    vec3 ambient = texture(irradiance_map, normal).rgb * albedo.rgb * occlusion;
+    color = tonemap_aces((color + ambient) * camera.exposure);
+    out_color = vec4(pow(color, vec3(1.0 / 2.2)), albedo.a);
+}
@@ -0,0 +1,40 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+// Declarations that the symbols from the syntax tree are checked against.
+
+#include "lighting.glsl"
+#include "exposure.glsl"
+
+struct Material {
+    vec3 base_color;
+    float roughness;
+};
+
+layout(set = 0, binding = 0) uniform Globals {
+    float time;
+    vec2 resolution;
+};
+
+layout(location = 0) out vec4 out_color;
+
+const Material default_material = Material(vec3(0.8), 0.5);
+
+float blend(float from, float to)
+{
+    return mix(from, to, 0.5);
+}
+
+vec3 blend(vec3 from, vec3 to)
+{
+    return mix(from, to, 0.5);
+}
+
+void main()
+{
+    vec3 tint;
+    float pulse = blend(0.0, sin(time));
+    tint = vec3(pulse * exposure_scale(1.0));
+    vec3 color = blend(default_material.base_color, tint);
+    out_color = vec4(color * default_material.roughness / PI, gl_FragCoord.x / resolution.x);
+}
@@ -0,0 +1,75 @@
+#include "analysiscache.hpp"
+
+#include "utils.hpp"
+
+size_t AnalysisCache::KeyHash::operator()(const AnalysisKey& key) const
+{
+    return hash_bytes(key.uri, key.content_hash ^ key.environment_hash);
+}
+
+/// Estimates the memory held by an analysis, in bytes.
+static size_t get_analysis_size(const AnalysisKey& key, const Analysis& analysis)
+{
+    size_t size = sizeof(Analysis) + key.uri.size() + analysis.diagnostics.dump().size();
+    if (analysis.symbols) size += analysis.symbols->memory_usage();
+    for (const auto& include : analysis.includes) size += include.size();
+    return size;
+}
+
+std::shared_ptr<const Analysis> AnalysisCache::get(const AnalysisKey& key)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->analysis;
+}
+
+void AnalysisCache::put(const AnalysisKey& key, std::shared_ptr<const Analysis> analysis)
+{
+    size_t size = get_analysis_size(key, *analysis);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (auto it = m_index.find(key); it != m_index.end()) {
+        m_size -= it->second->size;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+    m_entries.push_front(Entry{ key, std::move(analysis), size });
+    m_index.emplace(key, m_entries.begin());
+    m_size += size;
+    evict();
+}
+
+void AnalysisCache::set_budget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_budget = budget;
+    evict();
+}
+
+void AnalysisCache::evict()
+{
+    while (m_size > m_budget && !m_entries.empty()) {
+        Entry& entry = m_entries.back();
+        m_size -= entry.size;
+        m_index.erase(entry.key);
+        m_entries.pop_back();
+    }
+}
+
+json AnalysisCache::stats()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return json{
+        { "entries", m_entries.size() },
+        { "bytes", m_size },
+        { "budget_bytes", m_budget },
+        { "hits", m_hits },
+        { "misses", m_misses },
+    };
+}
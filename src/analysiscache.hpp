@@ -0,0 +1,83 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "symbols.hpp"
+
+using json = nlohmann::json;
+
+/// Identifies everything a parse of a document depends on.
+struct AnalysisKey {
+    std::string uri;
+    /// The hash of the document's text.
+    uint64_t content_hash;
+    /// The hash of the target environment and of the uris and contents of
+    /// the files the document includes.
+    uint64_t environment_hash;
+
+    bool operator==(const AnalysisKey&) const = default;
+};
+
+/// The results of parsing one version of a document.
+struct Analysis {
+    json diagnostics;
+    std::shared_ptr<const SymbolTable> symbols;
+    /// The uris of all files the parse included, including nested ones.
+    std::set<std::string> includes;
+};
+
+/// Keeps the analyses of recently parsed documents, so that parsing a text
+/// again in an unchanged environment (eg. on save, after an undo, or when a
+/// header is touched without changing) is a lookup. The least recently used
+/// analyses are evicted once their estimated size exceeds the budget.
+///
+/// Entries are never invalidated explicitly: a change to the text or to an
+/// included file changes the key, and the stale entry ages out.
+class AnalysisCache {
+public:
+    static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+    explicit AnalysisCache(size_t budget = DEFAULT_BUDGET) : m_budget(budget) {}
+
+    /// Returns the analysis for `key`, or null if there is none. May be
+    /// called from any thread.
+    std::shared_ptr<const Analysis> get(const AnalysisKey& key);
+
+    /// Stores the analysis for `key`, replacing any previous one. May be
+    /// called from any thread.
+    void put(const AnalysisKey& key, std::shared_ptr<const Analysis> analysis);
+
+    /// Sets the budget in bytes, evicting entries until they fit.
+    void set_budget(size_t budget);
+
+    json stats();
+
+private:
+    struct KeyHash {
+        size_t operator()(const AnalysisKey& key) const;
+    };
+    struct Entry {
+        AnalysisKey key;
+        std::shared_ptr<const Analysis> analysis;
+        size_t size;
+    };
+
+    void evict();
+
+    std::mutex m_mutex;
+    size_t m_budget;
+    size_t m_size = 0;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+    /// Ordered from most to least recently used.
+    std::list<Entry> m_entries;
+    std::unordered_map<AnalysisKey, std::list<Entry>::iterator, KeyHash> m_index;
+};
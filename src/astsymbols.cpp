@@ -0,0 +1,369 @@
+#include "astsymbols.hpp"
+
+#ifdef HAVE_PARSED_SYMBOLS
+
+#include <algorithm>
+#include <map>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace {
+
+/// A declaration found in the syntax tree, before it is located in the text.
+struct ParsedSymbol {
+    std::string name;
+    Symbol::Kind kind;
+    std::string details;
+    /// The file the parser read the declaration from, or empty if the parser
+    /// did not record where the declaration is.
+    std::string file;
+    /// The parser's one-based line and column, which point at the name or at
+    /// a token after it (eg. the closing parenthesis of a function header).
+    int line = 0;
+    int column = 0;
+};
+
+ParsedSymbol make_parsed_symbol(std::string name, Symbol::Kind kind, std::string details,
+        const glslang::TSourceLoc& loc)
+{
+    ParsedSymbol symbol{ std::move(name), kind, std::move(details), "", 0, 0 };
+    if (loc.name && loc.line > 0) {
+        symbol.file = loc.name->c_str();
+        symbol.line = loc.line;
+        symbol.column = loc.column;
+    }
+    return symbol;
+}
+
+/// Returns the GLSL spelling of a type, eg. `vec3`, `sampler2D` or `Light[4]`.
+std::string get_type_name(const glslang::TType& type)
+{
+    std::string name;
+    switch (type.getBasicType()) {
+        case glslang::EbtStruct:
+        case glslang::EbtBlock:
+            name = type.getTypeName().c_str();
+            break;
+        case glslang::EbtSampler:
+            name = type.getSampler().getString().c_str();
+            break;
+        default: {
+            const char* prefix = "";
+            switch (type.getBasicType()) {
+                case glslang::EbtDouble: prefix = "d"; break;
+                case glslang::EbtInt: prefix = "i"; break;
+                case glslang::EbtUint: prefix = "u"; break;
+                case glslang::EbtBool: prefix = "b"; break;
+                default: break;
+            }
+            if (type.isMatrix()) {
+                name = prefix + std::string("mat") + std::to_string(type.getMatrixCols());
+                if (type.getMatrixRows() != type.getMatrixCols()) {
+                    name += "x" + std::to_string(type.getMatrixRows());
+                }
+            } else if (type.isVector()) {
+                name = prefix + std::string("vec") + std::to_string(type.getVectorSize());
+            } else {
+                name = type.getBasicTypeString().c_str();
+            }
+        }
+    }
+
+    if (type.isArray()) {
+        const glslang::TArraySizes* sizes = type.getArraySizes();
+        for (int i = 0; i < sizes->getNumDims(); i++) {
+            int size = sizes->getDimSize(i);
+            name += size > 0 ? "[" + std::to_string(size) + "]" : "[]";
+        }
+    }
+    return name;
+}
+
+/// Collects the declarations of a syntax tree.
+///
+/// Global variables only appear in the tree where they are used or
+/// initialized, and in the linker objects glslang appends to the root, so a
+/// variable is global if it is a linker object or is seen outside of a
+/// function body.
+class SymbolCollector : public glslang::TIntermTraverser {
+public:
+    SymbolCollector() : glslang::TIntermTraverser(true, false, true) {}
+
+    /// Functions, types and global variables.
+    std::vector<ParsedSymbol> globals;
+    /// Members of structs and named blocks.
+    std::vector<ParsedSymbol> members;
+    /// Parameters and local variables.
+    std::vector<ParsedSymbol> locals;
+
+    bool visitAggregate(glslang::TVisit visit, glslang::TIntermAggregate* node) override
+    {
+        switch (node->getOp()) {
+            case glslang::EOpFunction:
+                if (visit == glslang::EvPreVisit) add_function(*node);
+                m_in_function = visit == glslang::EvPreVisit;
+                return true;
+            case glslang::EOpLinkerObjects:
+                if (visit == glslang::EvPreVisit) {
+                    for (glslang::TIntermNode* child : node->getSequence()) {
+                        if (auto symbol = child->getAsSymbolNode()) {
+                            m_linker_objects.insert(symbol->getId());
+                            see_symbol(*symbol);
+                        }
+                    }
+                }
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    void visitSymbol(glslang::TIntermSymbol* node) override
+    {
+        see_symbol(*node);
+    }
+
+    /// Sorts the variables seen during the traversal into globals and locals.
+    void finish()
+    {
+        for (const auto& [node, in_function] : m_variables) {
+            std::string name = node->getName().c_str();
+            const glslang::TType& type = node->getType();
+
+            bool global = !in_function || m_linker_objects.count(node->getId()) != 0;
+            bool anonymous_block = name.starts_with("anon@");
+            add_type(type, anonymous_block ? globals : members);
+            if (anonymous_block) continue;
+
+            if (global) {
+                // The node may be any use of the variable, so it does not tell
+                // where the declaration is.
+                globals.push_back(ParsedSymbol{ name, Symbol::Constant, get_type_name(type), "", 0, 0 });
+            } else {
+                locals.push_back(make_parsed_symbol(name, Symbol::Constant, get_type_name(type), node->getLoc()));
+            }
+        }
+    }
+
+private:
+    struct SeenVariable {
+        glslang::TIntermSymbol* node;
+        bool in_function;
+    };
+
+    void see_symbol(glslang::TIntermSymbol& node)
+    {
+        if (node.getName().empty() || node.getName().compare(0, 3, "gl_") == 0) return;
+        if (!m_variable_ids.insert(node.getId()).second) return;
+        m_variables.push_back(SeenVariable{ &node, m_in_function });
+    }
+
+    void add_function(glslang::TIntermAggregate& node)
+    {
+        std::string name = node.getName().c_str();
+        name = name.substr(0, name.find('('));
+
+        add_type(node.getType(), members);
+        std::string details = get_type_name(node.getType());
+
+        const glslang::TIntermSequence& sequence = node.getSequence();
+        auto parameters = sequence.empty() ? nullptr : sequence[0]->getAsAggregate();
+        if (parameters && !parameters->getSequence().empty()) {
+            details += " (";
+            bool first = true;
+            for (glslang::TIntermNode* child : parameters->getSequence()) {
+                auto parameter = child->getAsSymbolNode();
+                if (!parameter) continue;
+                if (!first) details += ", ";
+                first = false;
+
+                const glslang::TType& type = parameter->getType();
+                add_type(type, members);
+                switch (type.getQualifier().storage) {
+                    case glslang::EvqOut: details += "out "; break;
+                    case glslang::EvqInOut: details += "inout "; break;
+                    default: break;
+                }
+                details += get_type_name(type);
+                if (!parameter->getName().empty()) {
+                    details += " ";
+                    details += parameter->getName().c_str();
+                }
+            }
+            details += ")";
+        }
+
+        // Overloads share one symbol, which lists all of their signatures.
+        auto [overload, inserted] = m_functions.emplace(name, globals.size());
+        if (inserted) {
+            globals.push_back(make_parsed_symbol(name, Symbol::Function, details, node.getLoc()));
+        } else {
+            std::string& existing = globals[overload->second].details;
+            if (("\n" + existing + "\n").find("\n" + details + "\n") == std::string::npos) {
+                existing += "\n" + details;
+            }
+        }
+    }
+
+    /// Adds the struct or block `type` and its members, once per type name.
+    void add_type(const glslang::TType& type, std::vector<ParsedSymbol>& member_symbols)
+    {
+        if (type.getBasicType() != glslang::EbtStruct && type.getBasicType() != glslang::EbtBlock) return;
+        const glslang::TTypeList* type_members = type.getStruct();
+        if (!type_members || !m_types.insert(type.getTypeName().c_str()).second) return;
+
+        // The parser does not record where the type name is, but it precedes
+        // the first member.
+        glslang::TSourceLoc first_member{};
+        if (!type_members->empty()) first_member = type_members->front().loc;
+        globals.push_back(make_parsed_symbol(type.getTypeName().c_str(), Symbol::Type, "<type>", first_member));
+
+        for (const glslang::TTypeLoc& member : *type_members) {
+            add_type(*member.type, members);
+            member_symbols.push_back(make_parsed_symbol(member.type->getFieldName().c_str(), Symbol::Constant,
+                    get_type_name(*member.type), member.loc));
+        }
+    }
+
+    bool m_in_function = false;
+    std::vector<SeenVariable> m_variables;
+    std::unordered_set<long long> m_variable_ids;
+    std::unordered_set<long long> m_linker_objects;
+    /// The index into `globals` of each function.
+    std::map<std::string, size_t> m_functions;
+    std::unordered_set<std::string> m_types;
+};
+
+/// Whether the identifier at `offset` looks like it is being declared: it
+/// follows a type or a keyword introducing a name, like `float x` or
+/// `struct Light`, rather than an operator or punctuation.
+bool is_declaration(std::string_view text, size_t offset)
+{
+    size_t end = offset;
+    while (end > 0 && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\n'
+            || text[end - 1] == '\r')) {
+        end--;
+    }
+    size_t start = end;
+    while (start > 0 && is_identifier_char(text[start - 1])) start--;
+    if (start == end || !is_identifier_start_char(text[start])) return false;
+
+    std::string_view previous = text.substr(start, end - start);
+    return previous != "return" && previous != "else" && previous != "case";
+}
+
+/// Finds declarations in the text of the files the parser read.
+class SymbolLocator {
+public:
+    SymbolLocator(const std::string& uri, const Document& document, const std::vector<std::string>& includes,
+            const DocumentLookup& lookup)
+        : m_uri(uri), m_document(document), m_includes(includes), m_lookup(lookup) {}
+
+    Symbol::Location locate(const ParsedSymbol& symbol)
+    {
+        if (!symbol.file.empty()) {
+            const Document* document = get_document(symbol.file);
+            if (!document) return {};
+            auto occurrences = document->occurrences().find(symbol.name);
+            if (occurrences.empty()) return {};
+
+            // The name is the last occurrence up to the parser's position.
+            // Occurrences are at least two bytes apart, so allowing one byte
+            // past the position also accepts zero-based columns.
+            const LineIndex& line_index = document->line_index();
+            if (symbol.line > line_index.line_count()) {
+                return { intern_uri(symbol.file), int(occurrences.front()) };
+            }
+            std::string_view line = line_index.line(symbol.line - 1);
+            size_t position = (line.data() - document->text().data()) + std::max(symbol.column - 1, 0) + 1;
+            auto after = std::upper_bound(occurrences.begin(), occurrences.end(), position);
+            if (after == occurrences.begin()) return { intern_uri(symbol.file), int(occurrences.front()) };
+
+            // The parser's position may be a use instead, eg. for locals
+            // declared without an initializer, which have no node of their own.
+            // Their declaration is the closest one before it.
+            for (auto it = after; it != occurrences.begin(); --it) {
+                if (is_declaration(document->text(), *(it - 1))) return { intern_uri(symbol.file), int(*(it - 1)) };
+            }
+            return { intern_uri(symbol.file), int(*(after - 1)) };
+        }
+
+        // Without a position, rely on declarations preceding their uses:
+        // look through the included files in the order they were included,
+        // then the document itself.
+        for (const auto& include : m_includes) {
+            if (auto location = find_declaration(include, symbol.name)) return *location;
+        }
+        if (auto location = find_declaration(m_uri, symbol.name)) return *location;
+        return {};
+    }
+
+private:
+    /// Returns the first occurrence of `name` in a file that looks like a
+    /// declaration, if there is one.
+    std::optional<Symbol::Location> find_declaration(const std::string& uri, std::string_view name)
+    {
+        const Document* document = get_document(uri);
+        if (!document) return std::nullopt;
+        for (uint32_t offset : document->occurrences().find(name)) {
+            if (is_declaration(document->text(), offset)) return Symbol::Location{ intern_uri(uri), int(offset) };
+        }
+        return std::nullopt;
+    }
+
+    const Document* get_document(const std::string& uri)
+    {
+        if (uri == m_uri) return &m_document;
+        auto it = m_documents.find(uri);
+        if (it == m_documents.end()) it = m_documents.emplace(uri, m_lookup(uri)).first;
+        return it->second ? &*it->second : nullptr;
+    }
+
+    const std::string& m_uri;
+    const Document& m_document;
+    const std::vector<std::string>& m_includes;
+    const DocumentLookup& m_lookup;
+    std::map<std::string, std::optional<Document>> m_documents;
+};
+
+} // namespace
+
+std::shared_ptr<const SymbolTable> extract_parsed_symbols(const glslang::TIntermediate& intermediate,
+        const std::string& uri, const Document& document, const std::vector<std::string>& includes,
+        const DocumentLookup& lookup, const CancellationToken& token)
+{
+    SymbolCollector collector;
+    if (glslang::TIntermNode* root = intermediate.getTreeRoot()) {
+        root->traverse(&collector);
+    }
+    collector.finish();
+    token.check();
+
+    auto symbols = std::make_shared<SymbolTable>();
+    SymbolLocator locator(uri, document, includes, lookup);
+    auto add = [&](const std::vector<ParsedSymbol>& parsed, bool require_location) {
+        for (const ParsedSymbol& symbol : parsed) {
+            // Locating a symbol may read and index another file.
+            token.check();
+            if (symbols->contains(symbol.name)) continue;
+            Symbol::Location location = locator.locate(symbol);
+            if (require_location && !location.has_uri()) continue;
+            symbols->emplace(symbol.name, Symbol{ symbol.kind, symbol.details, location });
+        }
+    };
+
+    // Earlier symbols win, so globals take precedence over members and
+    // locals that share their name. Globals that can not be found in the
+    // text are left to `extract_symbols`, which does know where they are if
+    // it finds them at all.
+    add(collector.globals, true);
+    extract_symbols(document.text().c_str(), *symbols, intern_uri(uri));
+    add(collector.members, false);
+    add(collector.locals, false);
+    return symbols;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+// The syntax tree is not part of glslang's public API, so this needs its
+// internal headers. Without them, symbols are only scanned from the text.
+#ifdef HAVE_PARSED_SYMBOLS
+
+#include <glslang/MachineIndependent/localintermediate.h>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cancellation.hpp"
+#include "document.hpp"
+#include "symbols.hpp"
+
+/// Returns the document with the given uri, if it can be read.
+using DocumentLookup = std::function<std::optional<Document>(const std::string& uri)>;
+
+/// Builds the symbols of a document from the syntax tree of its diagnostics
+/// parse: functions with all of their overloads, structs, global variables,
+/// block and struct members, and the parameters and locals of function
+/// bodies. Declarations the tree does not keep, such as folded constants or
+/// everything after a fatal error, are filled in by `extract_symbols`.
+///
+/// Symbols declared in `includes`, given in the order they were included, are
+/// located in those files, which are read
+/// through `lookup`. Throws `RequestCancelled` once `token` is cancelled.
+std::shared_ptr<const SymbolTable> extract_parsed_symbols(const glslang::TIntermediate& intermediate,
+        const std::string& uri, const Document& document, const std::vector<std::string>& includes,
+        const DocumentLookup& lookup, const CancellationToken& token);
+
+#endif
@@ -0,0 +1,56 @@
+#include "builtins.hpp"
+
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/MachineIndependent/Initialize.h>
+
+#include <map>
+#include <mutex>
+
+static std::shared_ptr<const BuiltinSymbols> build_builtin_symbols(const BuiltinSymbolsKey& key)
+{
+    glslang::SpvVersion spv_version{};
+    spv_version.spv = key.spv_version;
+    spv_version.vulkanRelaxed = true; // be maximally permissive, allowing certain OpenGL in Vulkan
+
+    glslang::TPoolAllocator pool{};
+    glslang::SetThreadPoolAllocator(&pool);
+    pool.push();
+
+    auto builtin_symbols = std::make_shared<BuiltinSymbols>();
+    SymbolTable* symbols = &builtin_symbols->symbols;
+    {
+        const TBuiltInResource& resources = *GetDefaultResources();
+        glslang::TBuiltIns builtins{};
+        builtins.initialize(key.version, key.profile, spv_version);
+        builtins.initialize(resources, key.version, key.profile, spv_version, key.language);
+
+        add_builtin_types(*symbols);
+        extract_symbols(builtins.getCommonString().c_str(), *symbols);
+        extract_symbols(builtins.getStageString(key.language).c_str(), *symbols);
+    }
+
+    glslang::GetThreadPoolAllocator().pop();
+    glslang::SetThreadPoolAllocator(nullptr);
+
+    builtin_symbols->completion_index = CompletionIndex(*symbols);
+    return builtin_symbols;
+}
+
+static std::mutex cache_mutex;
+static std::map<BuiltinSymbolsKey, std::shared_ptr<const BuiltinSymbols>> cache;
+
+std::shared_ptr<const BuiltinSymbols> get_builtin_symbols(const BuiltinSymbolsKey& key)
+{
+    std::lock_guard<std::mutex> lock{cache_mutex};
+    auto& entry = cache[key];
+    if (!entry) {
+        entry = build_builtin_symbols(key);
+    }
+    return entry;
+}
+
+void clear_builtin_symbols()
+{
+    std::lock_guard<std::mutex> lock{cache_mutex};
+    cache.clear();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/MachineIndependent/Versions.h>
+
+#include <compare>
+#include <memory>
+
+#include "completion.hpp"
+#include "symbols.hpp"
+
+/// Identifies one set of builtin declarations as generated by glslang.
+struct BuiltinSymbolsKey {
+    EShLanguage language;
+    int version;
+    EProfile profile;
+    glslang::EShTargetLanguageVersion spv_version;
+
+    auto operator<=>(const BuiltinSymbolsKey&) const = default;
+};
+
+/// The symbols declared by glslang's builtin prelude.
+struct BuiltinSymbols {
+    SymbolTable symbols;
+    CompletionIndex completion_index;
+};
+
+/// Returns the builtin symbols for the given stage and target. They are built
+/// on first use and shared by every later caller, so they must not be modified.
+std::shared_ptr<const BuiltinSymbols> get_builtin_symbols(const BuiltinSymbolsKey& key);
+
+/// Drops all cached builtin symbols, so that the next lookup rebuilds them.
+/// Symbols handed out earlier stay valid. Used to measure cold starts.
+void clear_builtin_symbols();
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+/// Thrown by work that stops early because its result is no longer wanted.
+class RequestCancelled : public std::exception {
+public:
+    const char* what() const noexcept override { return "Request cancelled"; }
+};
+
+/// Tells long-running work that its result is no longer wanted. Copies share
+/// the same state, so the copy kept by whoever may cancel the work controls
+/// the copies passed to it. A default-constructed token is never cancelled.
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    /// Returns a token that can be cancelled.
+    static CancellationToken create()
+    {
+        CancellationToken token;
+        token.m_cancelled = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    void cancel() const
+    {
+        if (m_cancelled) m_cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool is_cancelled() const
+    {
+        return m_cancelled && m_cancelled->load(std::memory_order_relaxed);
+    }
+
+    /// Throws `RequestCancelled` if the token was cancelled.
+    void check() const
+    {
+        if (is_cancelled()) throw RequestCancelled();
+    }
+
+    /// Whether both tokens are copies of the same one.
+    bool operator==(const CancellationToken&) const = default;
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
@@ -0,0 +1,62 @@
+#include "completion.hpp"
+
+#include <algorithm>
+
+static char to_lower(char c) {
+    return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static std::string to_lower(std::string_view s) {
+    std::string lower(s);
+    for (char& c : lower) c = to_lower(c);
+    return lower;
+}
+
+/// Returns `true` if all characters of `needle` appear in `haystack` in order.
+static bool is_subsequence(std::string_view needle, std::string_view haystack) {
+    size_t i = 0;
+    for (char c : haystack) {
+        if (i < needle.size() && needle[i] == c) i++;
+    }
+    return i == needle.size();
+}
+
+bool CompletionMatch::operator<(const CompletionMatch& other) const {
+    if (quality != other.quality) return quality > other.quality;
+    if (name.size() != other.name.size()) return name.size() < other.name.size();
+    return name < other.name;
+}
+
+CompletionIndex::CompletionIndex(const SymbolTable& symbols) {
+    m_entries.reserve(symbols.size());
+    for (auto& entry : symbols) {
+        if (entry.name.empty()) continue;
+        m_entries.push_back(Entry{ to_lower(entry.name), entry.name, &entry.symbol });
+    }
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+        return a.key < b.key;
+    });
+}
+
+void CompletionIndex::find(std::string_view prefix, std::vector<CompletionMatch>& out) const {
+    if (prefix.empty()) return;
+
+    std::string lower_prefix = to_lower(prefix);
+    auto first = std::lower_bound(m_entries.begin(), m_entries.end(), lower_prefix[0],
+            [](const Entry& entry, char c) { return entry.key[0] < c; });
+
+    for (auto it = first; it != m_entries.end() && it->key[0] == lower_prefix[0]; ++it) {
+        std::string_view key = it->key;
+        CompletionMatch::Quality quality;
+        if (it->name.starts_with(prefix)) {
+            quality = CompletionMatch::Prefix;
+        } else if (key.starts_with(lower_prefix)) {
+            quality = CompletionMatch::CaseInsensitivePrefix;
+        } else if (is_subsequence(lower_prefix, key)) {
+            quality = CompletionMatch::Fuzzy;
+        } else {
+            continue;
+        }
+        out.push_back(CompletionMatch{ it->name, it->symbol, quality });
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "symbols.hpp"
+
+/// A symbol that matched a completion prefix.
+struct CompletionMatch {
+    enum Quality {
+        /// The letters of the prefix appear in order, ignoring case.
+        Fuzzy = 0,
+        /// The name starts with the prefix, ignoring case.
+        CaseInsensitivePrefix = 1,
+        /// The name starts with the prefix.
+        Prefix = 2,
+    };
+
+    std::string_view name;
+    const Symbol* symbol;
+    Quality quality;
+
+    /// Orders better matches first: by quality, then shorter names, then by name.
+    bool operator<(const CompletionMatch& other) const;
+};
+
+/// The names of a symbol table, sorted case-insensitively, so that candidates
+/// for a prefix are found without visiting every symbol. The index refers to
+/// the table, which must outlive it.
+class CompletionIndex {
+public:
+    CompletionIndex() = default;
+    explicit CompletionIndex(const SymbolTable& symbols);
+
+    /// Appends every symbol matching `prefix` to `out`. Matches must start
+    /// with the same letter as the prefix, ignoring case.
+    void find(std::string_view prefix, std::vector<CompletionMatch>& out) const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::string_view name;
+        const Symbol* symbol;
+    };
+
+    std::vector<Entry> m_entries;
+};
@@ -0,0 +1,77 @@
+#include "diagnosticsworker.hpp"
+
+#include <algorithm>
+#include <utility>
+
+DiagnosticsWorker::DiagnosticsWorker(Analyze analyze, Publish publish, std::chrono::milliseconds delay)
+    : m_analyze(std::move(analyze))
+    , m_publish(std::move(publish))
+    , m_delay(delay)
+    , m_thread(&DiagnosticsWorker::run, this)
+{
+}
+
+DiagnosticsWorker::~DiagnosticsWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop = true;
+        m_running_token.cancel();
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void DiagnosticsWorker::schedule(const std::string& uri, Document document)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_generations[uri] += 1;
+        m_pending[uri] = Request{ std::move(document), std::chrono::steady_clock::now() + m_delay };
+        if (uri == m_running_uri) {
+            m_running_token.cancel();
+        }
+    }
+    m_condition.notify_all();
+}
+
+void DiagnosticsWorker::run()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (!m_stop) {
+        if (m_pending.empty()) {
+            m_condition.wait(lock);
+            continue;
+        }
+
+        auto next = std::min_element(m_pending.begin(), m_pending.end(), [](const auto& a, const auto& b) {
+            return a.second.deadline < b.second.deadline;
+        });
+        if (next->second.deadline > std::chrono::steady_clock::now()) {
+            m_condition.wait_until(lock, next->second.deadline);
+            continue;
+        }
+
+        std::string uri = next->first;
+        Request request = std::move(next->second);
+        m_pending.erase(next);
+        uint64_t generation = m_generations[uri];
+        m_running_uri = uri;
+        m_running_token = CancellationToken::create();
+        CancellationToken token = m_running_token;
+
+        lock.unlock();
+        json diagnostics = m_analyze(uri, request.document, token);
+        lock.lock();
+
+        m_running_uri.clear();
+        m_running_token = CancellationToken();
+
+        // A newer change arrived while we were busy, so this result is stale.
+        if (m_generations[uri] != generation) continue;
+
+        lock.unlock();
+        m_publish(uri, request.document.version(), std::move(diagnostics));
+        lock.lock();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "cancellation.hpp"
+#include "document.hpp"
+
+using json = nlohmann::json;
+
+/// Computes diagnostics on a background thread.
+///
+/// Requests are debounced per document: a document is only parsed once no
+/// newer request for it has arrived for `delay`. A newer request replaces a
+/// pending one. A parse that is superseded while it is running is cancelled
+/// through its token, and its result is dropped instead of published.
+class DiagnosticsWorker {
+public:
+    /// Computes the diagnostics for a snapshot of a document. May stop early
+    /// once `token` is cancelled, as the result will not be published.
+    using Analyze = std::function<json(const std::string& uri, const Document& document,
+            const CancellationToken& token)>;
+    /// Sends the diagnostics for a document version to the client.
+    using Publish = std::function<void(const std::string& uri, int version, json diagnostics)>;
+
+    DiagnosticsWorker(Analyze analyze, Publish publish, std::chrono::milliseconds delay);
+    ~DiagnosticsWorker();
+
+    /// Schedules diagnostics for the given snapshot of a document.
+    void schedule(const std::string& uri, Document document);
+
+private:
+    struct Request {
+        Document document;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void run();
+
+    Analyze m_analyze;
+    Publish m_publish;
+    std::chrono::milliseconds m_delay;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::map<std::string, Request> m_pending;
+    /// Incremented for every request, so that stale results can be detected.
+    std::map<std::string, uint64_t> m_generations;
+    /// The document being analyzed, if any, and the token of its analysis.
+    std::string m_running_uri;
+    CancellationToken m_running_token;
+    bool m_stop = false;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,113 @@
+#include "document.hpp"
+
+#include <utility>
+
+Document::Document(std::string text, int version)
+    : m_rope(text)
+    , m_version(version)
+{
+    m_cache->text = std::move(text);
+}
+
+const std::string& Document::text() const
+{
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    if (!m_cache->text) {
+        m_cache->text = m_rope.to_string();
+    }
+    return *m_cache->text;
+}
+
+void Document::set_text(std::string text)
+{
+    m_rope = Rope(text);
+    m_cache = std::make_shared<Cache>();
+    m_cache->text = std::move(text);
+}
+
+void Document::replace(SourceFileLocation start, SourceFileLocation end, std::string_view text)
+{
+    size_t start_offset = offset_at(start.line, start.character);
+    size_t end_offset = offset_at(end.line, end.character);
+    m_rope.replace(start_offset, end_offset, text);
+    m_cache = std::make_shared<Cache>();
+}
+
+const LineIndex& Document::line_index() const
+{
+    const std::string& text = this->text();
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    if (!m_cache->line_index) {
+        m_cache->line_index.emplace(text);
+    }
+    return *m_cache->line_index;
+}
+
+const OccurrenceIndex& Document::occurrences() const
+{
+    const std::string& text = this->text();
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    if (!m_cache->occurrences) {
+        m_cache->occurrences.emplace(text);
+    }
+    return *m_cache->occurrences;
+}
+
+uint64_t Document::content_hash() const
+{
+    const std::string& text = this->text();
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    if (!m_cache->content_hash) {
+        m_cache->content_hash = hash_bytes(text);
+    }
+    return *m_cache->content_hash;
+}
+
+std::shared_ptr<const SymbolTable> Document::scanned_symbols(uint32_t uri) const
+{
+    const std::string& text = this->text();
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    if (!m_cache->scanned_symbols) {
+        auto symbols = std::make_shared<SymbolTable>();
+        extract_symbols(text.c_str(), *symbols, uri);
+        m_cache->scanned_symbols = std::move(symbols);
+    }
+    return m_cache->scanned_symbols;
+}
+
+std::shared_ptr<const SymbolTable> Document::parsed_symbols() const
+{
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    return m_cache->parsed_symbols;
+}
+
+void Document::set_parsed_symbols(std::shared_ptr<const SymbolTable> symbols) const
+{
+    std::lock_guard<std::mutex> lock{m_cache->mutex};
+    m_cache->parsed_symbols = std::move(symbols);
+}
+
+size_t Document::offset_at(int line, int character) const
+{
+    if (line < 0) return 0;
+
+    // Walk the line until we have passed `character` UTF-16 code units. The
+    // bytes of a multi-byte character may be split across chunks.
+    size_t offset = m_rope.line_offset(line);
+    int continuation_bytes = 0;
+    m_rope.for_each_chunk(offset, [&](std::string_view chunk) {
+        for (char c : chunk) {
+            if (continuation_bytes > 0) {
+                continuation_bytes -= 1;
+            } else {
+                if (character <= 0 || c == '\n') return false;
+                int length = utf8_sequence_length(c);
+                character -= length == 4 ? 2 : 1;
+                continuation_bytes = length - 1;
+            }
+            offset += 1;
+        }
+        return true;
+    });
+    return offset;
+}
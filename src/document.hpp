@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "lineindex.hpp"
+#include "occurrences.hpp"
+#include "rope.hpp"
+#include "symbols.hpp"
+#include "utils.hpp"
+
+/// The contents of a text document, as synchronized with the client.
+///
+/// Edits are applied to a rope, so a ranged change does not copy the whole
+/// text. A contiguous copy of the text is materialized lazily when something
+/// (eg. the parser) needs one. Copying a `Document` is cheap, and copies of
+/// the same version share that contiguous copy, so a snapshot can be handed
+/// to another thread.
+class Document {
+public:
+    Document() = default;
+    Document(std::string text, int version = 0);
+
+    /// The version number sent by the client, increasing with every change.
+    int version() const { return m_version; }
+    void set_version(int version) { m_version = version; }
+
+    /// Returns the contents as a contiguous, null-terminated string.
+    const std::string& text() const;
+
+    /// Replaces the whole contents.
+    void set_text(std::string text);
+
+    /// Replaces the text between the two positions with `text`.
+    void replace(SourceFileLocation start, SourceFileLocation end, std::string_view text);
+
+    /// Returns the line index of the current version, building it on first
+    /// use. It refers to the string returned by `text()`.
+    const LineIndex& line_index() const;
+
+    /// Returns the identifier occurrences of the current version, building
+    /// them on first use. They refer to the string returned by `text()`.
+    const OccurrenceIndex& occurrences() const;
+
+    /// Returns the hash of the current version's text, computing it on first use.
+    uint64_t content_hash() const;
+
+    /// Returns the symbols found by scanning the current version's text,
+    /// located in the document with the given interned uri. They are built
+    /// on first use; `uri` must be the same for every call.
+    std::shared_ptr<const SymbolTable> scanned_symbols(uint32_t uri) const;
+
+    /// Returns the symbols found by parsing the current version, or null if
+    /// it has not been parsed yet.
+    std::shared_ptr<const SymbolTable> parsed_symbols() const;
+
+    /// Records the symbols found by parsing the current version. Copies of
+    /// the same version see them as well.
+    void set_parsed_symbols(std::shared_ptr<const SymbolTable> symbols) const;
+
+    /// Returns the contents of the given zero-indexed line, without the line
+    /// break. Lines past the end of the text are empty.
+    std::string_view line(int line) const { return line_index().line(line); }
+
+    /// Returns the byte offset for the given character, counted in UTF-16
+    /// code units, on the given line.
+    size_t offset_at(int line, int character) const;
+
+private:
+    /// Data derived from the text, shared by all copies of one version.
+    struct Cache {
+        std::mutex mutex;
+        std::optional<std::string> text;
+        std::optional<LineIndex> line_index;
+        std::optional<OccurrenceIndex> occurrences;
+        std::optional<uint64_t> content_hash;
+        std::shared_ptr<const SymbolTable> scanned_symbols;
+        std::shared_ptr<const SymbolTable> parsed_symbols;
+    };
+
+    Rope m_rope;
+    int m_version = 0;
+    std::shared_ptr<Cache> m_cache = std::make_shared<Cache>();
+};
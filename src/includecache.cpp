@@ -0,0 +1,65 @@
+#include "includecache.hpp"
+
+#include <sys/stat.h>
+
+#include "utils.hpp"
+
+/// How long a missing file is assumed to stay missing.
+static const auto NEGATIVE_ENTRY_LIFETIME = std::chrono::seconds(2);
+
+bool IncludeCache::FileStamp::operator==(const FileStamp& other) const
+{
+    return inode == other.inode && size == other.size
+        && mtime.tv_sec == other.mtime.tv_sec && mtime.tv_nsec == other.mtime.tv_nsec;
+}
+
+static bool stat_file(const std::string& path, struct stat& info)
+{
+    return ::stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+std::optional<Document> IncludeCache::get(const std::string& path)
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto it = m_entries.find(path);
+        if (it != m_entries.end() && !it->second.document && now < it->second.retry_after) {
+            return std::nullopt;
+        }
+    }
+
+    struct stat info;
+    if (!stat_file(path, info)) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_entries[path] = Entry{ {}, std::nullopt, now + NEGATIVE_ENTRY_LIFETIME };
+        return std::nullopt;
+    }
+
+    FileStamp stamp;
+    stamp.inode = info.st_ino;
+    stamp.size = info.st_size;
+#ifdef __APPLE__
+    stamp.mtime = info.st_mtimespec;
+#else
+    stamp.mtime = info.st_mtim;
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto it = m_entries.find(path);
+        if (it != m_entries.end() && it->second.document && it->second.stamp == stamp) {
+            return it->second.document;
+        }
+    }
+
+    // Read outside the lock. If another thread loads the same file meanwhile,
+    // the last one to finish wins, which is harmless.
+    auto contents = read_file_to_string(path.c_str());
+    if (!contents) return std::nullopt;
+
+    Document document(std::move(*contents));
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_entries[path] = Entry{ stamp, document, {} };
+    return document;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "document.hpp"
+
+/// Caches the contents of included files that are not open in the editor.
+///
+/// Entries are revalidated with a single `stat` on every lookup and reloaded
+/// if the modification time, size or inode have changed, so edits made outside
+/// the editor are picked up. Files that could not be found are remembered for
+/// a short while, so that parses do not retry them over and over.
+///
+/// Files are kept as documents, so data derived from their text, like the
+/// line index, is also built once per version of the file.
+class IncludeCache {
+public:
+    /// Returns the file at `path`, or `std::nullopt` if it cannot be read.
+    /// May be called from any thread.
+    std::optional<Document> get(const std::string& path);
+
+private:
+    /// Identifies one version of a file on disk.
+    struct FileStamp {
+        ino_t inode = 0;
+        off_t size = 0;
+        struct timespec mtime = {};
+
+        bool operator==(const FileStamp& other) const;
+    };
+
+    struct Entry {
+        FileStamp stamp;
+        /// Empty if the file was missing.
+        std::optional<Document> document;
+        /// When a missing file should be looked for again.
+        std::chrono::steady_clock::time_point retry_after;
+    };
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+};
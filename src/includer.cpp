@@ -1,6 +1,7 @@
 #include "includer.hpp"
 
 #include <filesystem>
+#include <memory>
 #include "utils.hpp"
 
 namespace fs = std::filesystem;
@@ -8,16 +9,29 @@ namespace fs = std::filesystem;
 using IncludeResult = FileIncluder::IncludeResult;
 
 void FileIncluder::releaseInclude(IncludeResult* result) {
+    delete static_cast<std::shared_ptr<const std::string>*>(result->userData);
     delete result;
 }
 
+IncludeResult* FileIncluder::includeSystem(
+        const char* header_name,
+        const char*,
+        size_t)
+{
+    this->missing.insert(header_name);
+    return nullptr;
+}
+
 IncludeResult* FileIncluder::includeLocal(
         const char* header_name,
         const char* includer_name,
         size_t depth)
 {
     auto suffix = strip_prefix("file://", includer_name);
-    if (!suffix) return nullptr;
+    if (!suffix) {
+        this->missing.insert(header_name);
+        return nullptr;
+    }
 
     fs::path path = suffix;
     path.replace_filename(header_name);
@@ -26,19 +40,23 @@ IncludeResult* FileIncluder::includeLocal(
     std::string uri = "file://";
     uri += path.string();
 
-    auto& documents = this->workspace->documents();
-
-    auto existing = documents.find(uri);
-    if (existing == documents.end()) {
-        // load the file
-        if (auto contents = read_file_to_string(path.string().c_str())) {
-            documents[uri] = *contents;
-            existing = documents.find(uri);
-        } else {
+    auto document = this->workspace->get_document(uri);
+    if (!document) {
+        document = this->cache->get(path.string());
+        if (!document) {
+            this->missing.insert(uri);
             return nullptr;
         }
     }
+    auto snapshot = std::make_shared<Document>(std::move(*document));
+    std::shared_ptr<const std::string> contents(snapshot, &snapshot->text());
+
+    if (this->included.insert(uri).second) {
+        this->order.push_back(uri);
+        this->content_hashes.emplace(uri, snapshot->content_hash());
+    }
 
-    const std::string& contents = existing->second;
-    return new IncludeResult{uri, contents.c_str(), contents.size(), nullptr};
+    // The contents must stay alive until glslang releases the include.
+    auto owner = new std::shared_ptr<const std::string>(std::move(contents));
+    return new IncludeResult{uri, (*owner)->c_str(), (*owner)->size(), owner};
 }
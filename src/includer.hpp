@@ -1,16 +1,51 @@
 #pragma once
 
 #include <glslang/Public/ShaderLang.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "includecache.hpp"
 #include "workspace.hpp"
 
+/// Resolves includes relative to the including file. Open documents are read
+/// from the workspace, and all other files through the include cache.
 class FileIncluder : public glslang::TShader::Includer {
     Workspace* workspace;
+    IncludeCache* cache;
+    std::set<std::string> included;
+    std::vector<std::string> order;
+    std::map<std::string, uint64_t> content_hashes;
+    std::set<std::string> missing;
 
 public:
-    FileIncluder(Workspace* workspace) : workspace(workspace) {}
+    FileIncluder(Workspace* workspace, IncludeCache* cache) : workspace(workspace), cache(cache) {}
+
+    /// The uris of all files that were included so far, including nested ones.
+    const std::set<std::string>& included_files() const { return included; }
+
+    /// The same uris, in the order in which they were first included.
+    const std::vector<std::string>& include_order() const { return order; }
+
+    /// The same uris, with the content hash of the text that was handed to
+    /// glslang when each of them was first included.
+    const std::map<std::string, uint64_t>& included_contents() const { return content_hashes; }
+
+    /// The uris (or, if they have none, the names) of the includes that
+    /// could not be read.
+    const std::set<std::string>& missing_files() const { return missing; }
 
     virtual void releaseInclude(IncludeResult*) override;
 
+    /// System includes are not supported, so this only records the failure.
+    virtual IncludeResult* includeSystem(
+            const char* header_name,
+            const char* includer_name,
+            size_t depth) override;
+
     virtual IncludeResult* includeLocal(
             const char* header_name,
             const char* includer_name,
@@ -0,0 +1,63 @@
+#include "infolog.hpp"
+
+#include <charconv>
+
+static bool is_digit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+static bool is_upper(char c) {
+    return 'A' <= c && c <= 'Z';
+}
+
+std::optional<InfoLogMessage> parse_info_log_line(std::string_view line)
+{
+    // The severity is the run of capital letters in front of the first ": ".
+    size_t severity_end = line.find(": ");
+    if (severity_end == std::string_view::npos) return std::nullopt;
+
+    size_t severity_start = severity_end;
+    while (severity_start > 0 && is_upper(line[severity_start - 1])) severity_start--;
+
+    // File names may contain colons themselves, so the line number is taken
+    // from the last ":<digits>: " in the rest of the line.
+    std::string_view rest = line.substr(severity_end + 2);
+    size_t message_start = rest.size();
+    while (message_start > 0) {
+        size_t colon = rest.rfind(": ", message_start - 1);
+        if (colon == std::string_view::npos) return std::nullopt;
+
+        size_t digits_start = colon;
+        while (digits_start > 0 && is_digit(rest[digits_start - 1])) digits_start--;
+
+        if (digits_start < colon && digits_start > 0 && rest[digits_start - 1] == ':') {
+            InfoLogMessage message;
+            message.severity = line.substr(severity_start, severity_end - severity_start);
+            message.file = rest.substr(0, digits_start - 1);
+            std::from_chars(rest.data() + digits_start, rest.data() + colon, message.line);
+
+            std::string_view text = rest.substr(colon + 2);
+            size_t text_start = text.find_first_not_of(' ');
+            size_t text_end = text.find_last_not_of(' ');
+            if (text_start != std::string_view::npos) {
+                message.message = text.substr(text_start, text_end - text_start + 1);
+            }
+            return message;
+        }
+
+        message_start = colon;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::string_view> find_message_identifier(std::string_view message)
+{
+    size_t open = message.find('\'');
+    if (open == std::string_view::npos) return std::nullopt;
+
+    size_t close = message.rfind("' : ");
+    if (close == std::string_view::npos || close <= open) return std::nullopt;
+
+    return message.substr(open + 1, close - open - 1);
+}
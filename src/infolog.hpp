@@ -0,0 +1,37 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+/// A message from glslang's info log, which has the form
+/// `SEVERITY: file:line: message`. All views point into the log.
+struct InfoLogMessage {
+    std::string_view severity;
+    std::string_view file;
+    int line = 0;
+    /// The message, without leading or trailing spaces.
+    std::string_view message;
+};
+
+/// Parses a single line of the info log. Returns `std::nullopt` for lines that
+/// are not messages, like the summary glslang appends.
+std::optional<InfoLogMessage> parse_info_log_line(std::string_view line);
+
+/// Calls `f` with every message in the info log.
+template <typename F>
+void for_each_info_log_message(std::string_view log, F&& f)
+{
+    while (!log.empty()) {
+        size_t eol = log.find('\n');
+        std::string_view line = log.substr(0, eol);
+        log.remove_prefix(eol == std::string_view::npos ? log.size() : eol + 1);
+
+        if (auto message = parse_info_log_line(line)) {
+            f(*message);
+        }
+    }
+}
+
+/// Returns the identifier quoted at the start of messages like
+/// `'foo' : undeclared identifier`, or `std::nullopt` if there is none.
+std::optional<std::string_view> find_message_identifier(std::string_view message);
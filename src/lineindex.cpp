@@ -0,0 +1,73 @@
+#include "lineindex.hpp"
+
+#include <algorithm>
+
+LineIndex::LineIndex(std::string_view text)
+    : m_text(text)
+{
+    m_line_starts.push_back(0);
+    bool non_ascii = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '\n') {
+            m_non_ascii.push_back(non_ascii);
+            m_line_starts.push_back(i + 1);
+            non_ascii = false;
+        } else if (c & 0x80) {
+            non_ascii = true;
+        }
+    }
+    m_non_ascii.push_back(non_ascii);
+}
+
+std::string_view LineIndex::line(int line) const
+{
+    if (line < 0 || line >= line_count()) return {};
+
+    size_t start = m_line_starts[line];
+    size_t end = line + 1 < line_count() ? m_line_starts[line + 1] - 1 : m_text.size();
+    return m_text.substr(start, end - start);
+}
+
+int LineIndex::offset(int line, int character) const
+{
+    if (line < 0) return 0;
+    if (line >= line_count()) return m_text.size();
+
+    std::string_view text = this->line(line);
+    int start = m_line_starts[line];
+    if (!m_non_ascii[line]) {
+        return start + std::clamp(character, 0, static_cast<int>(text.size()));
+    }
+
+    size_t column = 0;
+    while (character > 0 && column < text.size()) {
+        int length = utf8_sequence_length(text[column]);
+        character -= length == 4 ? 2 : 1;
+        column = std::min(column + length, text.size());
+    }
+    return start + column;
+}
+
+SourceFileLocation LineIndex::position(int offset) const
+{
+    offset = std::clamp(offset, 0, static_cast<int>(m_text.size()));
+    auto next_line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), static_cast<uint32_t>(offset));
+    int line = next_line - m_line_starts.begin() - 1;
+    return SourceFileLocation{ line, character(line, offset - m_line_starts[line]) };
+}
+
+int LineIndex::character(int line, int byte_column) const
+{
+    if (line < 0 || line >= line_count() || !m_non_ascii[line]) return byte_column;
+
+    std::string_view text = this->line(line).substr(0, std::max(byte_column, 0));
+    int character = 0;
+    size_t column = 0;
+    while (column < text.size()) {
+        int length = utf8_sequence_length(text[column]);
+        character += length == 4 ? 2 : 1;
+        column += length;
+    }
+    return character;
+}
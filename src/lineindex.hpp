@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "utils.hpp"
+
+/// Maps between byte offsets into a text and LSP positions, whose characters
+/// are counted in UTF-16 code units.
+///
+/// Building the index records where every line starts and which lines contain
+/// non-ASCII characters. Lookups are a binary search, plus a scan of a single
+/// line when its byte and UTF-16 columns differ. The index refers to the text
+/// it was built from, which must outlive it.
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view text);
+
+    /// Number of lines in the text (one more than the number of newlines).
+    int line_count() const { return static_cast<int>(m_line_starts.size()); }
+
+    /// Returns the contents of the given line, without the line break. Lines
+    /// outside the text are empty.
+    std::string_view line(int line) const;
+
+    /// Returns the byte offset for the given character on the given line.
+    /// Positions past the end of a line map to the end of that line.
+    int offset(int line, int character) const;
+
+    /// Given a byte offset into the text, returns the corresponding position.
+    SourceFileLocation position(int offset) const;
+
+    /// Converts a byte offset within the given line to a UTF-16 column.
+    int character(int line, int byte_column) const;
+
+private:
+    std::string_view m_text;
+    std::vector<uint32_t> m_line_starts;
+    /// Lines containing multi-byte characters, whose byte columns do not
+    /// match their UTF-16 columns.
+    std::vector<bool> m_non_ascii;
+};
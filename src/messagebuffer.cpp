@@ -1,68 +1,64 @@
 #include "messagebuffer.hpp"
 
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
 MessageBuffer::MessageBuffer() {}
 MessageBuffer::~MessageBuffer() {}
 
-void MessageBuffer::handle_char(char c)
+size_t MessageBuffer::handle_data(const char* data, size_t size)
 {
-    m_raw_message += c;
-
-    auto new_header = try_parse_header(m_raw_message);
-    // Check whether we were actually able to parse a header.
-    // If so, add it to our known headers.
-    // We'll also reset our string then.
-    if (!std::get<0>(new_header).empty()) {
-        m_headers[std::get<0>(new_header)] = std::get<1>(new_header);
-        m_raw_message.clear();
-    }
+    size_t consumed = 0;
 
-    // A sole \r\n is the separator between the header block and the body block
-    // but we don't need it.
-    if (m_raw_message == "\r\n") {
-        m_raw_message.clear();
-        m_is_header_done = true;
+    // Collect whole header lines until we reach the sole \r\n that separates
+    // the header block from the body block.
+    while (!m_is_header_done && consumed < size) {
+        auto newline = static_cast<const char*>(std::memchr(data + consumed, '\n', size - consumed));
+        size_t line_end = newline ? newline - data + 1 : size;
+        m_raw_headers.append(data + consumed, line_end - consumed);
+        consumed = line_end;
+
+        if (newline) {
+            std::string_view headers = m_raw_headers;
+            if (headers == "\r\n" || headers.ends_with("\r\n\r\n")) {
+                parse_headers();
+            }
+        }
     }
 
-    if (m_is_header_done) {
+    if (m_is_header_done && !m_is_completed) {
         // Now that we know that we're in the body, we just have to count until
         // we reach the length of the body as provided in the Content-Length
         // header.
-        auto content_length = std::stoul(m_headers["Content-Length"]);
-        if (m_raw_message.length() == content_length) {
-            m_body = json::parse(m_raw_message);
+        size_t body_size = std::min(size - consumed, m_content_length - m_raw_message.size());
+        m_raw_message.append(data + consumed, body_size);
+        consumed += body_size;
+
+        if (m_raw_message.size() == m_content_length) {
+            m_body = json::parse(m_raw_message, nullptr, false);
+            if (m_body.is_discarded()) {
+                // Let the message handler report the parse error.
+                m_body = json::object();
+            }
+            m_is_completed = true;
         }
     }
+
+    return consumed;
 }
 
-void MessageBuffer::handle_string(std::string s)
+void MessageBuffer::handle_char(char c)
 {
-    m_raw_message += s;
-
-    auto new_header = try_parse_header(m_raw_message);
-    // Check whether we were actually able to parse a header.
-    // If so, add it to our known headers.
-    // We'll also reset our string then.
-    if (!std::get<0>(new_header).empty()) {
-        m_headers[std::get<0>(new_header)] = std::get<1>(new_header);
-        m_raw_message.clear();
-    }
-
-    // A sole \r\n is the separator between the header block and the body block
-    // but we don't need it.
-    if (m_raw_message == "\r\n") {
-        m_raw_message.clear();
-        m_is_header_done = true;
-    }
+    handle_data(&c, 1);
+}
 
-    if (m_is_header_done) {
-        // Now that we know that we're in the body, we just have to count until
-        // we reach the length of the body as provided in the Content-Length
-        // header.
-        auto content_length = std::stoul(m_headers["Content-Length"]);
-        if (m_raw_message.length() == content_length) {
-            m_body = json::parse(m_raw_message);
-        }
-    }
+void MessageBuffer::handle_string(const std::string& s)
+{
+    handle_data(s.data(), s.size());
 }
 
 const std::map<std::string, std::string>& MessageBuffer::headers() const
@@ -82,30 +78,66 @@ const std::string& MessageBuffer::raw() const
 
 bool MessageBuffer::message_completed()
 {
-    if (m_is_header_done && !m_body.empty()) {
-        return true;
-    }
-    return false;
+    return m_is_completed;
 }
 
-std::tuple<std::string, std::string> MessageBuffer::try_parse_header(std::string& message) const
+void MessageBuffer::parse_headers()
 {
-    auto eol_pos = m_raw_message.find("\r\n");
-    if (eol_pos != std::string::npos) {
-        std::string header_string = m_raw_message.substr(0, eol_pos);
+    std::string_view headers = m_raw_headers;
+    while (!headers.empty()) {
+        size_t eol_pos = headers.find("\r\n");
+        std::string_view header_string = headers.substr(0, eol_pos);
+        headers.remove_prefix(eol_pos == std::string_view::npos ? headers.size() : eol_pos + 2);
+
         auto delim_pos = header_string.find(":");
-        if (delim_pos != std::string::npos) {
-            std::string header_name = header_string.substr(0, delim_pos);
-            std::string header_value = header_string.substr(delim_pos + 1);
-            return std::make_tuple(header_name, header_value);
+        if (delim_pos != std::string_view::npos) {
+            std::string_view header_name = header_string.substr(0, delim_pos);
+            std::string_view header_value = header_string.substr(delim_pos + 1);
+            m_headers[std::string(header_name)] = std::string(header_value);
+
+            if (header_name == "Content-Length") {
+                auto digits_start = header_value.find_first_not_of(' ');
+                if (digits_start != std::string_view::npos) {
+                    std::from_chars(header_value.data() + digits_start,
+                            header_value.data() + header_value.size(), m_content_length);
+                }
+            }
         }
     }
-    return std::make_tuple(std::string{}, std::string{});
+
+    m_raw_message.reserve(m_content_length);
+    m_is_header_done = true;
 }
 
 void MessageBuffer::clear() {
+    m_raw_headers.clear();
     m_raw_message.clear();
     m_headers.clear();
-    m_body.clear();
+    m_content_length = 0;
+    m_body = nullptr;
     m_is_header_done = false;
+    m_is_completed = false;
+}
+
+/// Space reserved in front of a serialized body for the message header.
+static const size_t RESPONSE_HEADER_RESERVE = 128;
+
+std::string_view make_response(json response, std::string& buffer, bool pretty)
+{
+    response["jsonrpc"] = "2.0";
+
+    // Only the public API of the json library is used, so that builds against
+    // other versions of it keep working; this costs one copy of the body.
+    buffer.assign(RESPONSE_HEADER_RESERVE, ' ');
+    buffer.append(response.dump(pretty ? 4 : -1, ' ', false, json::error_handler_t::replace));
+
+    size_t content_length = buffer.size() - RESPONSE_HEADER_RESERVE;
+    char header[RESPONSE_HEADER_RESERVE];
+    int header_length = fmt::format_to_n(header, sizeof(header),
+            "Content-Length: {}\r\nContent-Type: application/vscode-jsonrpc;charset=utf-8\r\n\r\n",
+            content_length).size;
+
+    size_t start = RESPONSE_HEADER_RESERVE - header_length;
+    buffer.replace(start, header_length, header, header_length);
+    return std::string_view(buffer).substr(start);
 }
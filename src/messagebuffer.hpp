@@ -3,8 +3,10 @@
 
 #include <nlohmann/json.hpp>
 
+#include <cstddef>
+#include <map>
 #include <string>
-#include <tuple>
+#include <string_view>
 
 using json = nlohmann::json;
 
@@ -12,8 +14,14 @@ class MessageBuffer {
 public:
     MessageBuffer();
     virtual ~MessageBuffer();
+
+    /// Consumes input up to the end of the current message and returns the
+    /// number of bytes used. Any remaining bytes belong to the next message
+    /// and should be passed in again after `clear()`.
+    size_t handle_data(const char* data, size_t size);
     void handle_char(char c);
-    void handle_string(std::string s);
+    void handle_string(const std::string& s);
+
     const std::map<std::string, std::string>& headers() const;
     const json& body() const;
     const std::string& raw() const;
@@ -21,15 +29,24 @@ public:
     void clear();
 
 private:
-    std::tuple<std::string, std::string> try_parse_header(std::string &message) const;
+    void parse_headers();
 
+    std::string m_raw_headers;
     std::string m_raw_message;
     std::map<std::string, std::string> m_headers;
+    size_t m_content_length = 0;
     json m_body;
 
     // This is set once a sole \r\n is encountered because it denotes that the
     // header is done.
     bool m_is_header_done = false;
+    bool m_is_completed = false;
 };
 
+/// Serializes `response` as a JSON-RPC message into `buffer`, reusing its
+/// storage, and returns the complete message (header and body). The body is
+/// serialized once, and the header is then written into the space reserved
+/// in front of it.
+std::string_view make_response(json response, std::string& buffer, bool pretty);
+
 #endif /* MESSAGEBUFFER_H */
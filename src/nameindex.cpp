@@ -0,0 +1,185 @@
+#include "nameindex.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include "symbolindex.hpp"
+
+/// The number of removed declarations below which the index is never compacted.
+static const size_t MIN_COMPACT_COUNT = 4096;
+
+static char to_lower(char c)
+{
+    return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static std::string to_lower(std::string_view string)
+{
+    std::string lowercase(string);
+    for (char& c : lowercase) c = to_lower(c);
+    return lowercase;
+}
+
+static uint32_t trigram_at(std::string_view string, size_t i)
+{
+    return uint32_t(uint8_t(string[i])) << 16 | uint32_t(uint8_t(string[i + 1])) << 8 | uint8_t(string[i + 2]);
+}
+
+/// Returns `true` if the characters of `query` appear in `name` in order.
+static bool is_subsequence(std::string_view query, std::string_view name)
+{
+    size_t i = 0;
+    for (char c : name) {
+        if (i < query.size() && c == query[i]) i++;
+    }
+    return i == query.size();
+}
+
+void NameIndex::add(std::string_view uri, std::string_view name, Symbol::Kind kind, std::string_view details,
+        int offset, SourceFileLocation position)
+{
+    uint32_t name_id = m_strings.intern(name);
+    auto [it, inserted] = m_name_indices.emplace(name_id, m_names.size());
+    uint32_t name_index = it->second;
+    if (inserted) {
+        Name& entry = m_names.emplace_back(Name{ name_id, to_lower(name), {} });
+
+        // A trigram may occur several times in one name, but is only listed once.
+        std::vector<uint32_t> trigrams;
+        for (size_t i = 0; i + 3 <= entry.lowercase.size(); i++) {
+            trigrams.push_back(trigram_at(entry.lowercase, i));
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        for (uint32_t trigram : trigrams) {
+            m_trigrams[trigram].push_back(name_index);
+        }
+    }
+
+    uint32_t uri_id = m_strings.intern(uri);
+    m_names[name_index].declarations.push_back({ uri_id, m_strings.intern(details), kind, offset, position });
+    m_file_names[uri_id].push_back(name_index);
+    m_declaration_count++;
+}
+
+void NameIndex::remove_file(std::string_view uri)
+{
+    auto uri_id = m_strings.find(uri);
+    if (!uri_id) return;
+    auto file = m_file_names.find(*uri_id);
+    if (file == m_file_names.end()) return;
+
+    // Names stay in the list even without declarations, since the trigram
+    // lists refer to them by index, until the index is compacted.
+    for (uint32_t name_index : file->second) {
+        auto& declarations = m_names[name_index].declarations;
+        auto removed = std::remove_if(declarations.begin(), declarations.end(), [&](const Declaration& d) {
+            return d.uri == *uri_id;
+        });
+        m_removed_count += declarations.end() - removed;
+        m_declaration_count -= declarations.end() - removed;
+        declarations.erase(removed, declarations.end());
+    }
+    m_file_names.erase(file);
+
+    if (m_removed_count > std::max(m_declaration_count, MIN_COMPACT_COUNT)) {
+        compact();
+    }
+}
+
+void NameIndex::compact()
+{
+    NameIndex compacted;
+    for (const Name& name : m_names) {
+        for (const Declaration& declaration : name.declarations) {
+            compacted.add(m_strings.get(declaration.uri), m_strings.get(name.id), declaration.kind,
+                    m_strings.get(declaration.details), declaration.offset, declaration.position);
+        }
+    }
+    *this = std::move(compacted);
+}
+
+std::vector<IndexedSymbol> NameIndex::search(std::string_view query, size_t limit) const
+{
+    enum Quality { Subsequence, Substring, Prefix };
+    struct Match {
+        Quality quality;
+        uint32_t name_index;
+    };
+    std::vector<Match> matches;
+    std::string lowercase_query = to_lower(query);
+
+    auto add_match = [&](uint32_t name_index) {
+        const Name& name = m_names[name_index];
+        if (name.declarations.empty()) return;
+
+        size_t position = name.lowercase.find(lowercase_query);
+        if (position == 0) {
+            matches.push_back({ Prefix, name_index });
+        } else if (position != std::string::npos) {
+            matches.push_back({ Substring, name_index });
+        } else if (is_subsequence(lowercase_query, name.lowercase)) {
+            matches.push_back({ Subsequence, name_index });
+        }
+    };
+
+    if (lowercase_query.size() < 3) {
+        for (uint32_t i = 0; i < m_names.size(); i++) add_match(i);
+    } else {
+        // Substring matches must contain every trigram of the query, so
+        // intersect their lists, starting with the shortest one.
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (size_t i = 0; i + 3 <= lowercase_query.size(); i++) {
+            auto it = m_trigrams.find(trigram_at(lowercase_query, i));
+            if (it == m_trigrams.end()) {
+                lists.clear();
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+
+        std::vector<uint32_t> candidates;
+        if (!lists.empty()) {
+            candidates = *lists[0];
+            for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+                std::vector<uint32_t> intersection;
+                std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                        std::back_inserter(intersection));
+                candidates = std::move(intersection);
+            }
+        }
+        for (uint32_t name_index : candidates) add_match(name_index);
+
+        // Only look for looser matches if no name contains the query, since
+        // that has to scan every name.
+        if (matches.empty()) {
+            for (uint32_t i = 0; i < m_names.size(); i++) add_match(i);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [&](const Match& a, const Match& b) {
+        if (a.quality != b.quality) return a.quality > b.quality;
+        std::string_view a_name = m_strings.get(m_names[a.name_index].id);
+        std::string_view b_name = m_strings.get(m_names[b.name_index].id);
+        if (a_name.size() != b_name.size()) return a_name.size() < b_name.size();
+        return a_name < b_name;
+    });
+
+    std::vector<IndexedSymbol> results;
+    for (const Match& match : matches) {
+        const Name& name = m_names[match.name_index];
+        for (const Declaration& declaration : name.declarations) {
+            if (results.size() >= limit) return results;
+            results.push_back({
+                std::string(m_strings.get(declaration.uri)),
+                std::string(m_strings.get(name.id)),
+                declaration.kind,
+                std::string(m_strings.get(declaration.details)),
+                declaration.offset,
+                declaration.position,
+            });
+        }
+    }
+    return results;
+}
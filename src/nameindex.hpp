@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "stringtable.hpp"
+#include "symbols.hpp"
+#include "utils.hpp"
+
+struct IndexedSymbol;
+
+/// An inverted index from symbol names to their declarations, answering
+/// fuzzy queries over every symbol in the workspace.
+///
+/// Names, uris and details are interned. Each distinct name is entered into
+/// a trigram index over its lowercase form, so that substring queries only
+/// visit names sharing all of the query's trigrams. Queries shorter than a
+/// trigram, and queries that no name contains, scan the list of distinct
+/// names for fuzzy matches, which is much shorter than the list of
+/// declarations.
+///
+/// Removing a file leaves its names and strings behind, so once more
+/// declarations have been removed than are left, the index is rebuilt from
+/// the remaining ones.
+class NameIndex {
+public:
+    struct Declaration {
+        uint32_t uri;
+        uint32_t details;
+        Symbol::Kind kind;
+        int offset;
+        SourceFileLocation position;
+    };
+
+    void add(std::string_view uri, std::string_view name, Symbol::Kind kind, std::string_view details,
+            int offset, SourceFileLocation position);
+
+    /// Removes all declarations in the given file.
+    void remove_file(std::string_view uri);
+
+    /// Returns up to `limit` declarations whose names match `query`, best
+    /// matches first. Names starting with the query rank above names that
+    /// contain it. Names that only contain its letters in order are returned
+    /// when no name contains the query. Case is ignored throughout.
+    std::vector<IndexedSymbol> search(std::string_view query, size_t limit) const;
+
+private:
+    /// Rebuilds the index from the current declarations, dropping the names
+    /// and strings that are no longer used.
+    void compact();
+
+    /// An entry of the name list, in the order names were first seen.
+    struct Name {
+        uint32_t id;
+        std::string lowercase;
+        std::vector<Declaration> declarations;
+    };
+
+    StringTable m_strings;
+    std::vector<Name> m_names;
+    /// Maps interned name ids to their index in `m_names`.
+    std::unordered_map<uint32_t, uint32_t> m_name_indices;
+    /// Maps each trigram to the indices in `m_names` containing it, ascending.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_trigrams;
+    /// Maps interned uri ids to the indices in `m_names` declared in that file.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_file_names;
+
+    size_t m_declaration_count = 0;
+    /// The number of declarations removed since the index was last compacted.
+    size_t m_removed_count = 0;
+};
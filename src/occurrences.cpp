@@ -0,0 +1,43 @@
+#include "occurrences.hpp"
+
+#include "scan.hpp"
+#include "utils.hpp"
+
+OccurrenceIndex::OccurrenceIndex(std::string_view text)
+{
+    TextScanner scanner(text.data(), text.data() + text.size());
+    auto skip_identifier = [&](size_t i) { return size_t(scanner.skip_identifier(text.data() + i) - text.data()); };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+
+        if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            size_t end = text.find('\n', i);
+            i = end == std::string_view::npos ? text.size() : end;
+        } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+            size_t end = text.find("*/", i + 2);
+            i = end == std::string_view::npos ? text.size() : end + 2;
+        } else if (c == '"') {
+            // only used by `#include`, but the path is not an identifier
+            size_t end = text.find_first_of("\"\n", i + 1);
+            i = end == std::string_view::npos ? text.size() : end + 1;
+        } else if ('0' <= c && c <= '9') {
+            // don't confuse numeric literals (eg. `1e5` or `2u`) with identifiers
+            i = skip_identifier(i + 1);
+        } else if (is_identifier_start_char(c)) {
+            size_t start = i;
+            i = skip_identifier(i);
+            m_occurrences[text.substr(start, i - start)].push_back(start);
+        } else {
+            i++;
+        }
+    }
+}
+
+std::span<const uint32_t> OccurrenceIndex::find(std::string_view name) const
+{
+    auto it = m_occurrences.find(name);
+    if (it == m_occurrences.end()) return {};
+    return it->second;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Maps every identifier in a text to the offsets where it occurs.
+///
+/// The index is built in a single pass over the text, skipping comments,
+/// string literals and numbers, so finding all uses of a name is a lookup.
+/// It refers to the text it was built from, which must outlive it.
+class OccurrenceIndex {
+public:
+    explicit OccurrenceIndex(std::string_view text);
+
+    /// Returns the byte offsets of all occurrences of `name`, in ascending order.
+    std::span<const uint32_t> find(std::string_view name) const;
+
+private:
+    std::unordered_map<std::string_view, std::vector<uint32_t>> m_occurrences;
+};
@@ -0,0 +1,167 @@
+#include "recording.hpp"
+
+#include <fmt/format.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "messagebuffer.hpp"
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64_encode(std::string_view data)
+{
+    std::string encoded;
+    encoded.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t group = uint32_t(uint8_t(data[i])) << 16;
+        if (i + 1 < data.size()) group |= uint32_t(uint8_t(data[i + 1])) << 8;
+        if (i + 2 < data.size()) group |= uint32_t(uint8_t(data[i + 2]));
+
+        encoded += BASE64_ALPHABET[(group >> 18) & 63];
+        encoded += BASE64_ALPHABET[(group >> 12) & 63];
+        encoded += i + 1 < data.size() ? BASE64_ALPHABET[(group >> 6) & 63] : '=';
+        encoded += i + 2 < data.size() ? BASE64_ALPHABET[group & 63] : '=';
+    }
+    return encoded;
+}
+
+/// Decodes base64, stopping at the first character outside of the alphabet.
+static std::string base64_decode(std::string_view encoded)
+{
+    std::string data;
+    data.reserve(encoded.size() / 4 * 3);
+    uint32_t group = 0;
+    int bits = 0;
+    for (char c : encoded) {
+        const char* digit = std::strchr(BASE64_ALPHABET, c);
+        if (c == '\0' || !digit) break;
+        group = (group << 6) | uint32_t(digit - BASE64_ALPHABET);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            data += char((group >> bits) & 0xff);
+        }
+    }
+    return data;
+}
+
+SessionRecorder::SessionRecorder(const std::string& path)
+    : m_output(path, std::ios::out | std::ios::trunc)
+    , m_start(std::chrono::steady_clock::now())
+{
+}
+
+void SessionRecorder::record(std::string_view body)
+{
+    auto elapsed = std::chrono::steady_clock::now() - m_start;
+    json entry{
+        { "time_us", std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() },
+        { "message", body },
+    };
+
+    std::string line;
+    try {
+        line = entry.dump();
+    } catch (const json::type_error&) {
+        // Not valid UTF-8.
+        entry.erase("message");
+        entry["message_base64"] = base64_encode(body);
+        line = entry.dump();
+    }
+
+    // A crashing server should still leave the messages leading up to the
+    // crash behind, so every line is flushed.
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_output << line << '\n';
+    m_output.flush();
+}
+
+/// Returns the value below which `fraction` of the sorted samples lie.
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index];
+}
+
+int replay_session(const std::string& path, bool realtime, AppState& appstate)
+{
+    std::ifstream input(path);
+    if (!input) {
+        fmt::print(stderr, "error: could not open recording '{}'\n", path);
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    std::map<std::string, std::vector<double>> latencies;
+    size_t message_count = 0;
+    size_t byte_count = 0;
+    size_t line_number = 0;
+    double handler_seconds = 0;
+
+    MessageBuffer message_buffer;
+    std::string line;
+    auto start = clock::now();
+    while (std::getline(input, line)) {
+        line_number++;
+        if (line.empty()) continue;
+
+        json entry = json::parse(line, nullptr, false);
+        std::string body;
+        if (entry.is_object() && entry.contains("message") && entry["message"].is_string()) {
+            body = entry["message"].get<std::string>();
+        } else if (entry.is_object() && entry.contains("message_base64") && entry["message_base64"].is_string()) {
+            body = base64_decode(entry["message_base64"].get_ref<const std::string&>());
+        } else {
+            fmt::print(stderr, "warning: skipping malformed line {} of the recording\n", line_number);
+            continue;
+        }
+
+        if (realtime) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(entry.value("time_us", int64_t{0})));
+        }
+
+        // Go through the same framing as the transports do.
+        message_buffer.handle_string(fmt::format("Content-Length: {}\r\n\r\n{}", body.size(), body));
+        if (!message_buffer.message_completed()) continue;
+
+        const json& message = message_buffer.body();
+        std::string method = message.is_object() ? message.value("method", "") : "";
+        if (method.empty()) method = "(response)";
+
+        auto handler_start = clock::now();
+        auto response = handle_message(message_buffer, appstate);
+        if (response) {
+            std::string buffer;
+            make_response(std::move(*response), buffer, appstate.pretty_print);
+        }
+        std::chrono::duration<double> elapsed = clock::now() - handler_start;
+
+        latencies[method].push_back(elapsed.count() * 1000);
+        handler_seconds += elapsed.count();
+        message_count++;
+        byte_count += body.size();
+        message_buffer.clear();
+    }
+    std::chrono::duration<double> total = clock::now() - start;
+
+    fmt::print("{:<40} {:>7} {:>9} {:>9} {:>9} {:>9}\n", "method", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (auto& [method, samples] : latencies) {
+        std::sort(samples.begin(), samples.end());
+        fmt::print("{:<40} {:>7} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n", method, samples.size(),
+                percentile(samples, 0.5), percentile(samples, 0.9), percentile(samples, 0.99), samples.back());
+    }
+    fmt::print("\n{} messages ({:.1f} KB) in {:.3f} s, {:.3f} s in handlers: {:.0f} messages/s\n",
+            message_count, byte_count / 1024.0, total.count(), handler_seconds,
+            handler_seconds > 0 ? message_count / handler_seconds : 0.0);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+struct AppState;
+
+/// Writes every message received from the client to a file, so that a
+/// session can be replayed later.
+///
+/// Each line of the file is a JSON object with the time in microseconds
+/// since recording started and the raw body of the message, which is kept
+/// as a string so that even malformed messages are reproduced exactly.
+/// Bodies that are not valid UTF-8 cannot be JSON strings, so they are
+/// stored base64-encoded under `message_base64` instead.
+class SessionRecorder {
+public:
+    explicit SessionRecorder(const std::string& path);
+
+    bool is_open() const { return m_output.is_open(); }
+
+    /// Records the body of a message. May be called from any thread.
+    void record(std::string_view body);
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_output;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/// Feeds a recorded session through the message handler without a client,
+/// discarding all output, then prints the latency of each method and the
+/// total throughput. With `realtime`, messages are delivered at the pace at
+/// which they were recorded; otherwise as fast as possible. Returns the exit
+/// code for the process.
+int replay_session(const std::string& path, bool realtime, AppState& appstate);
@@ -0,0 +1,231 @@
+#include "rope.hpp"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+
+/// Chunks are kept at or below this size so that an edit only ever copies a
+/// small amount of text.
+static const size_t MAX_CHUNK_SIZE = 1024;
+
+using NodePtr = std::shared_ptr<const Rope::Node>;
+
+struct Rope::Node {
+    /// Chunks are shared between copies of a node, so that copying the path to
+    /// an edit does not copy any text.
+    std::shared_ptr<const std::string> chunk;
+    NodePtr left;
+    NodePtr right;
+    uint32_t priority;
+
+    /// Number of bytes in this subtree.
+    size_t bytes;
+    /// Number of newlines in this subtree.
+    size_t newlines;
+    /// Number of newlines in `chunk` alone.
+    size_t chunk_newlines;
+};
+
+static size_t bytes(const NodePtr& node) { return node ? node->bytes : 0; }
+static size_t newlines(const NodePtr& node) { return node ? node->newlines : 0; }
+
+static uint32_t random_priority()
+{
+    thread_local std::minstd_rand rng{std::random_device{}()};
+    return rng();
+}
+
+static NodePtr make_node(NodePtr left, std::shared_ptr<const std::string> chunk, size_t chunk_newlines,
+        NodePtr right, uint32_t priority)
+{
+    auto node = std::make_shared<Rope::Node>();
+    node->bytes = bytes(left) + chunk->size() + bytes(right);
+    node->newlines = newlines(left) + chunk_newlines + newlines(right);
+    node->chunk_newlines = chunk_newlines;
+    node->chunk = std::move(chunk);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->priority = priority;
+    return node;
+}
+
+static NodePtr with_children(const NodePtr& node, NodePtr left, NodePtr right)
+{
+    return make_node(std::move(left), node->chunk, node->chunk_newlines, std::move(right), node->priority);
+}
+
+static NodePtr merge(const NodePtr& a, const NodePtr& b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    if (a->priority > b->priority) {
+        return with_children(a, a->left, merge(a->right, b));
+    } else {
+        return with_children(b, merge(a, b->left), b->right);
+    }
+}
+
+/// Splits the tree so that the first tree holds the first `offset` bytes.
+static std::pair<NodePtr, NodePtr> split(const NodePtr& node, size_t offset)
+{
+    if (!node) return { nullptr, nullptr };
+
+    size_t left_bytes = bytes(node->left);
+    if (offset <= left_bytes) {
+        auto [a, b] = split(node->left, offset);
+        return { a, with_children(node, b, node->right) };
+    }
+
+    size_t chunk_end = left_bytes + node->chunk->size();
+    if (offset >= chunk_end) {
+        auto [a, b] = split(node->right, offset - chunk_end);
+        return { with_children(node, node->left, a), b };
+    }
+
+    // The split point is inside this node's chunk.
+    std::string_view chunk = *node->chunk;
+    std::string_view head = chunk.substr(0, offset - left_bytes);
+    std::string_view tail = chunk.substr(offset - left_bytes);
+    size_t head_newlines = std::count(head.begin(), head.end(), '\n');
+    return {
+        make_node(node->left, std::make_shared<const std::string>(head), head_newlines, nullptr, node->priority),
+        make_node(nullptr, std::make_shared<const std::string>(tail), node->chunk_newlines - head_newlines,
+                node->right, node->priority),
+    };
+}
+
+/// Builds a tree from `text`, splitting it into evenly sized chunks.
+static NodePtr build(std::string_view text)
+{
+    NodePtr root;
+    size_t chunk_count = (text.size() + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
+    for (size_t i = 0; i < chunk_count; i++) {
+        size_t start = text.size() * i / chunk_count;
+        size_t end = text.size() * (i + 1) / chunk_count;
+        std::string_view chunk = text.substr(start, end - start);
+        size_t chunk_newlines = std::count(chunk.begin(), chunk.end(), '\n');
+        root = merge(root, make_node(nullptr, std::make_shared<const std::string>(chunk), chunk_newlines,
+                    nullptr, random_priority()));
+    }
+    return root;
+}
+
+static void append_to(const NodePtr& node, std::string& out)
+{
+    if (!node) return;
+    append_to(node->left, out);
+    out += *node->chunk;
+    append_to(node->right, out);
+}
+
+static bool visit_chunks(const NodePtr& node, size_t offset,
+        const std::function<bool(std::string_view)>& f)
+{
+    if (!node) return true;
+
+    size_t left_bytes = bytes(node->left);
+    if (offset < left_bytes) {
+        if (!visit_chunks(node->left, offset, f)) return false;
+        offset = left_bytes;
+    }
+
+    offset -= left_bytes;
+    size_t chunk_size = node->chunk->size();
+    if (offset < chunk_size) {
+        if (!f(std::string_view(*node->chunk).substr(offset))) return false;
+        offset = chunk_size;
+    }
+
+    return visit_chunks(node->right, offset - chunk_size, f);
+}
+
+Rope::Rope(std::string_view text)
+    : m_root(build(text))
+{
+}
+
+size_t Rope::size() const
+{
+    return bytes(m_root);
+}
+
+size_t Rope::line_count() const
+{
+    return newlines(m_root) + 1;
+}
+
+size_t Rope::line_offset(size_t line) const
+{
+    if (line == 0) return 0;
+    if (line > newlines(m_root)) return size();
+
+    // Find the `line`th newline; the line starts right after it.
+    size_t remaining = line;
+    size_t offset = 0;
+    const Node* node = m_root.get();
+    while (node) {
+        size_t left_newlines = newlines(node->left);
+        if (remaining <= left_newlines) {
+            node = node->left.get();
+            continue;
+        }
+
+        remaining -= left_newlines;
+        offset += bytes(node->left);
+
+        if (remaining <= node->chunk_newlines) {
+            size_t pos = 0;
+            while (true) {
+                pos = node->chunk->find('\n', pos);
+                if (--remaining == 0) break;
+                pos++;
+            }
+            return offset + pos + 1;
+        }
+
+        remaining -= node->chunk_newlines;
+        offset += node->chunk->size();
+        node = node->right.get();
+    }
+
+    return size();
+}
+
+void Rope::replace(size_t start, size_t end, std::string_view text)
+{
+    end = std::min(end, size());
+    start = std::min(start, end);
+
+    auto [left, rest] = split(m_root, start);
+    auto right = split(rest, end - start).second;
+
+    // Rebuild the chunks that touch the edit together with the new text, so
+    // that a long series of small edits does not fragment the rope.
+    const Node* last = left.get();
+    while (last && last->right) last = last->right.get();
+    const Node* first = right.get();
+    while (first && first->left) first = first->left.get();
+
+    std::string joined;
+    if (last) joined += *last->chunk;
+    joined += text;
+    if (first) joined += *first->chunk;
+
+    left = split(left, bytes(left) - (last ? last->chunk->size() : 0)).first;
+    right = split(right, first ? first->chunk->size() : 0).second;
+
+    m_root = merge(merge(left, build(joined)), right);
+}
+
+void Rope::for_each_chunk(size_t offset, const std::function<bool(std::string_view)>& f) const
+{
+    visit_chunks(m_root, offset, f);
+}
+
+std::string Rope::to_string() const
+{
+    std::string text;
+    text.reserve(size());
+    append_to(m_root, text);
+    return text;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/// An immutable-node rope of text chunks, balanced as an implicit treap.
+///
+/// Edits copy only the O(log n) nodes on the path to the change, so copying a
+/// `Rope` is cheap and copies never observe each other's edits.
+class Rope {
+public:
+    Rope() = default;
+    explicit Rope(std::string_view text);
+
+    /// Total length of the text in bytes.
+    size_t size() const;
+
+    /// Number of lines in the text (one more than the number of newlines).
+    size_t line_count() const;
+
+    /// Returns the byte offset at which the given zero-indexed line starts.
+    /// Lines past the end of the text map to `size()`.
+    size_t line_offset(size_t line) const;
+
+    /// Replaces the bytes in `[start, end)` with `text`.
+    void replace(size_t start, size_t end, std::string_view text);
+
+    /// Calls `f` with consecutive pieces of the text, starting at byte
+    /// `offset`, until `f` returns `false` or the text ends.
+    void for_each_chunk(size_t offset, const std::function<bool(std::string_view)>& f) const;
+
+    /// Returns the text as a contiguous string.
+    std::string to_string() const;
+
+    struct Node;
+
+private:
+    std::shared_ptr<const Node> m_root;
+};
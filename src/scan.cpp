@@ -0,0 +1,168 @@
+#include "scan.hpp"
+
+#include <atomic>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GLSLLS_SCAN_X86
+#include <immintrin.h>
+#endif
+
+/// Identifier characters and the characters `extract_symbols` acts on.
+enum CharClass : unsigned char {
+    IDENTIFIER = 1,
+    SYMBOL_TOKEN = 2,
+};
+
+static constexpr struct CharClassTable {
+    unsigned char classes[256] = {};
+
+    constexpr CharClassTable() {
+        for (int c = 0; c < 256; c++) {
+            bool identifier = ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_';
+            if (identifier) classes[c] |= IDENTIFIER | SYMBOL_TOKEN;
+        }
+        for (char c : { '{', '}', '(', ')', ';', '=' }) classes[(unsigned char)c] |= SYMBOL_TOKEN;
+    }
+} char_classes;
+
+static BlockClasses scalar_classify(const char* block, size_t size) {
+    BlockClasses classes;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = char_classes.classes[(unsigned char)block[i]];
+        classes.identifier |= uint64_t((c & IDENTIFIER) != 0) << i;
+        classes.symbol_token |= uint64_t((c & SYMBOL_TOKEN) != 0) << i;
+    }
+    return classes;
+}
+
+static BlockClasses scalar_classify_block(const char* block) {
+    return scalar_classify(block, TextScanner::BLOCK_SIZE);
+}
+
+#ifdef GLSLLS_SCAN_X86
+
+// Byte comparisons are signed, so bytes above 0x7f are negative and never
+// fall into the ranges below.
+
+static inline __m128i sse2_in_range(__m128i bytes, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(high + 1)));
+}
+
+static inline __m128i sse2_identifier_mask(__m128i bytes) {
+    // Setting bit 5 maps upper case letters to lower case, and no other byte
+    // into `a-z`.
+    __m128i letter = sse2_in_range(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = sse2_in_range(bytes, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+}
+
+static inline __m128i sse2_symbol_token_mask(__m128i bytes, __m128i identifier) {
+    __m128i braces = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('{')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('}')));
+    __m128i parens = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('(')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(')')));
+    __m128i ends = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(';')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('=')));
+    return _mm_or_si128(_mm_or_si128(identifier, braces), _mm_or_si128(parens, ends));
+}
+
+static BlockClasses sse2_classify_block(const char* block) {
+    BlockClasses classes;
+    for (size_t i = 0; i < TextScanner::BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        __m128i identifier = sse2_identifier_mask(bytes);
+        classes.identifier |= uint64_t(unsigned(_mm_movemask_epi8(identifier))) << i;
+        classes.symbol_token |= uint64_t(unsigned(_mm_movemask_epi8(sse2_symbol_token_mask(bytes, identifier)))) << i;
+    }
+    return classes;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_in_range(__m256i bytes, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(low - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), bytes));
+}
+
+AVX2 static inline __m256i avx2_identifier_mask(__m256i bytes) {
+    __m256i letter = avx2_in_range(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = avx2_in_range(bytes, '0', '9');
+    __m256i underscore = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+}
+
+AVX2 static inline __m256i avx2_symbol_token_mask(__m256i bytes, __m256i identifier) {
+    __m256i braces = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('{')),
+            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('}')));
+    __m256i parens = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('(')),
+            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(')')));
+    __m256i ends = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(';')),
+            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('=')));
+    return _mm256_or_si256(_mm256_or_si256(identifier, braces), _mm256_or_si256(parens, ends));
+}
+
+AVX2 static BlockClasses avx2_classify_block(const char* block) {
+    BlockClasses classes;
+    for (size_t i = 0; i < TextScanner::BLOCK_SIZE; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+        __m256i identifier = avx2_identifier_mask(bytes);
+        classes.identifier |= uint64_t(unsigned(_mm256_movemask_epi8(identifier))) << i;
+        classes.symbol_token |= uint64_t(unsigned(_mm256_movemask_epi8(avx2_symbol_token_mask(bytes, identifier)))) << i;
+    }
+    return classes;
+}
+
+#undef AVX2
+
+#endif
+
+using ClassifyBlock = BlockClasses (*)(const char* block);
+
+static ClassifyBlock get_classifier(ScanLevel level) {
+    switch (level) {
+#ifdef GLSLLS_SCAN_X86
+        case ScanLevel::AVX2: return avx2_classify_block;
+        case ScanLevel::SSE2: return sse2_classify_block;
+#endif
+        default: return scalar_classify_block;
+    }
+}
+
+ScanLevel best_scan_level() {
+#ifdef GLSLLS_SCAN_X86
+    // SSE2 is part of x86-64 itself.
+    return __builtin_cpu_supports("avx2") ? ScanLevel::AVX2 : ScanLevel::SSE2;
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+static std::atomic<ClassifyBlock>& current_classifier() {
+    static std::atomic<ClassifyBlock> classifier{ get_classifier(best_scan_level()) };
+    return classifier;
+}
+
+ScanLevel set_scan_level(ScanLevel level) {
+    if (level > best_scan_level()) level = best_scan_level();
+    current_classifier().store(get_classifier(level), std::memory_order_relaxed);
+    return level;
+}
+
+const char* get_scan_level_name(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::Scalar: return "scalar";
+        case ScanLevel::SSE2: return "sse2";
+        case ScanLevel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+TextScanner::TextScanner(const char* begin, const char* end)
+    : m_begin(begin), m_end(end), m_classify(current_classifier().load(std::memory_order_relaxed)) {}
+
+void TextScanner::load_block(const char* p) {
+    // Blocks are aligned to the start of the text, so that only the last one
+    // may be partial. That one is classified byte by byte, to not read past
+    // the end; the bits for the missing bytes stay clear.
+    m_block = m_begin + (p - m_begin) / BLOCK_SIZE * BLOCK_SIZE;
+    size_t size = m_end - m_block;
+    m_classes = size >= BLOCK_SIZE ? m_classify(m_block) : scalar_classify(m_block, size);
+}
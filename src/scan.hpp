@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// The instruction sets the text classifier is implemented for.
+enum class ScanLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+/// The classes of the bytes in one block of text, as bitmasks where bit `i`
+/// stands for byte `i` of the block.
+struct BlockClasses {
+    /// Identifier characters: letters, digits and `_`.
+    uint64_t identifier = 0;
+    /// The characters `extract_symbols` acts on: identifier characters and `{}();=`.
+    uint64_t symbol_token = 0;
+};
+
+/// Scans text for identifiers and declarations. The text is classified 64
+/// bytes at a time with the widest instruction set the CPU supports, and the
+/// queries then work on the resulting bitmasks, so that stepping over a short
+/// identifier costs a few bit operations instead of a branch per byte.
+class TextScanner {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    TextScanner(const char* begin, const char* end);
+
+    /// Returns the first character at or after `p` that can not be part of
+    /// an identifier, or the end of the text.
+    const char* skip_identifier(const char* p) {
+        while (p < m_end) {
+            size_t shift = load(p);
+            uint64_t others = ~m_classes.identifier >> shift;
+            if (others) return clamp(p + __builtin_ctzll(others));
+            p = m_block + BLOCK_SIZE;
+        }
+        return m_end;
+    }
+
+    /// Returns the first character at or after `p` that is relevant to
+    /// `extract_symbols`, or the end of the text.
+    const char* find_symbol_token(const char* p) {
+        while (p < m_end) {
+            size_t shift = load(p);
+            uint64_t tokens = m_classes.symbol_token >> shift;
+            if (tokens) return clamp(p + __builtin_ctzll(tokens));
+            p = m_block + BLOCK_SIZE;
+        }
+        return m_end;
+    }
+
+private:
+    /// Classifies the block containing `p`, unless it already is, and returns
+    /// the offset of `p` into it.
+    size_t load(const char* p) {
+        if (p < m_block || p >= m_block + BLOCK_SIZE) load_block(p);
+        return p - m_block;
+    }
+    void load_block(const char* p);
+
+    const char* clamp(const char* p) const { return p < m_end ? p : m_end; }
+
+    const char* m_begin;
+    const char* m_end;
+    BlockClasses (*m_classify)(const char* block);
+    /// The block that `m_classes` describes, or null.
+    const char* m_block = nullptr;
+    BlockClasses m_classes;
+};
+
+/// Returns the best scan level supported by the CPU.
+ScanLevel best_scan_level();
+
+/// Selects the classifier for `level`, if the CPU supports it, and returns
+/// the level in use. Affects scanners created afterwards. Meant for
+/// benchmarks comparing the implementations.
+ScanLevel set_scan_level(ScanLevel level);
+
+const char* get_scan_level_name(ScanLevel level);
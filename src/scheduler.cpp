@@ -0,0 +1,169 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+static json make_cancelled_response(const json& id)
+{
+    json error{
+        { "code", -32800 }, // RequestCancelled
+        { "message", "Request cancelled" },
+    };
+    return json{
+        { "id", id },
+        { "error", error },
+    };
+}
+
+RequestScheduler::RequestScheduler(size_t thread_count, Write write)
+    : m_write(std::move(write))
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&RequestScheduler::run, this);
+    }
+    m_writer = std::thread(&RequestScheduler::write_responses, this);
+}
+
+RequestScheduler::~RequestScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop = true;
+        for (auto& tasks : m_tasks) {
+            tasks.clear();
+        }
+    }
+    m_task_ready.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+
+    // The writer stops once the responses of the requests that did run have
+    // been written.
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop_writing = true;
+    }
+    m_response_ready.notify_all();
+    m_writer.join();
+}
+
+void RequestScheduler::submit(Priority priority, json id, Handler handler)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto token = CancellationToken::create();
+        m_in_flight.insert_or_assign(id, token);
+        m_pending.emplace(m_next_sequence, PendingResponse{ priority, false, std::nullopt });
+        m_tasks[static_cast<int>(priority)].push_back(Task{ m_next_sequence++, std::move(id), std::move(handler), token });
+    }
+    m_task_ready.notify_one();
+}
+
+void RequestScheduler::cancel(const json& id)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto in_flight = m_in_flight.find(id);
+    if (in_flight == m_in_flight.end()) return;
+    in_flight->second.cancel();
+
+    // A request that is still waiting can be answered without running it.
+    for (auto& tasks : m_tasks) {
+        auto task = std::find_if(tasks.begin(), tasks.end(), [&](const Task& task) { return task.id == id; });
+        if (task == tasks.end()) continue;
+
+        complete(task->sequence, make_cancelled_response(id));
+        tasks.erase(task);
+        m_in_flight.erase(in_flight);
+        return;
+    }
+}
+
+void RequestScheduler::respond(json response)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_pending.emplace(m_next_sequence, PendingResponse{ std::nullopt, false, std::nullopt });
+    complete(m_next_sequence++, std::move(response));
+}
+
+void RequestScheduler::complete(uint64_t sequence, std::optional<json> response)
+{
+    PendingResponse& pending = m_pending.at(sequence);
+    pending.completed = true;
+    pending.response = std::move(response);
+    m_response_ready.notify_one();
+}
+
+std::map<uint64_t, RequestScheduler::PendingResponse>::iterator RequestScheduler::find_writable()
+{
+    // The oldest response can always be written. Interactive responses may
+    // also pass background ones, but nothing passes any other response.
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
+        bool oldest = it == m_pending.begin();
+        if (it->second.completed && (oldest || it->second.priority == Priority::Interactive)) return it;
+        if (it->second.priority != Priority::Background) break;
+    }
+    return m_pending.end();
+}
+
+void RequestScheduler::run()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (true) {
+        m_task_ready.wait(lock, [&] {
+            return m_stop || std::any_of(std::begin(m_tasks), std::end(m_tasks), [](const auto& tasks) {
+                return !tasks.empty();
+            });
+        });
+        if (m_stop) break;
+
+        auto& tasks = *std::find_if(std::begin(m_tasks), std::end(m_tasks), [](const auto& tasks) {
+            return !tasks.empty();
+        });
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+
+        lock.unlock();
+        std::optional<json> response;
+        try {
+            response = task.handler(task.token);
+        } catch (const RequestCancelled&) {
+            response = make_cancelled_response(task.id);
+        } catch (...) {
+            // Leave the response empty, so that later ones are not held up.
+        }
+        lock.lock();
+
+        auto in_flight = m_in_flight.find(task.id);
+        if (in_flight != m_in_flight.end() && in_flight->second == task.token) {
+            m_in_flight.erase(in_flight);
+        }
+        complete(task.sequence, std::move(response));
+    }
+}
+
+void RequestScheduler::write_responses()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (true) {
+        m_response_ready.wait(lock, [&] { return m_stop_writing || find_writable() != m_pending.end(); });
+
+        // Write every response that is ready before waiting again.
+        auto next = find_writable();
+        if (next == m_pending.end()) break;
+        for (; next != m_pending.end(); next = find_writable()) {
+            std::optional<json> response = std::move(next->second.response);
+            m_pending.erase(next);
+
+            if (response) {
+                lock.unlock();
+                m_write(std::move(*response));
+                lock.lock();
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "cancellation.hpp"
+
+using json = nlohmann::json;
+
+/// Runs requests on a pool of threads, and writes their responses from a
+/// single thread.
+///
+/// Waiting requests are started by priority class, so that interactive
+/// requests overtake queued background work. Requests of one class start in
+/// submission order. Responses are written in submission order too, except
+/// that interactive responses do not wait for the responses to earlier
+/// background requests. Requests that have not started when the scheduler is
+/// destroyed are dropped, and so are the responses that have to wait for them.
+///
+/// Requests are tracked by id until they are answered, so that the client
+/// can cancel them. A cancelled request is answered with a `RequestCancelled`
+/// error: right away if it has not started, or once its handler notices the
+/// cancelled token and throws `RequestCancelled`.
+class RequestScheduler {
+public:
+    enum class Priority {
+        /// Requests the user is waiting on while typing, like hover or completion.
+        Interactive,
+        /// Requests that may take a while, like searching the workspace.
+        Background,
+    };
+
+    /// Computes the response to a request, if there is one. If it throws
+    /// anything but `RequestCancelled`, the request gets no response.
+    using Handler = std::function<std::optional<json>(const CancellationToken& token)>;
+    /// Sends a response to the client.
+    using Write = std::function<void(json response)>;
+
+    /// Starts `thread_count` threads, or one per core if it is zero, plus the
+    /// thread writing the responses.
+    RequestScheduler(size_t thread_count, Write write);
+    ~RequestScheduler();
+
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    /// Runs `handler` for the request with the given id on one of the threads.
+    void submit(Priority priority, json id, Handler handler);
+
+    /// Cancels the request with the given id, unless it was answered already.
+    void cancel(const json& id);
+
+    /// Writes a response computed by the caller, once the responses to all
+    /// earlier requests, background ones included, have been written.
+    void respond(json response);
+
+    size_t thread_count() const { return m_threads.size(); }
+
+private:
+    struct Task {
+        uint64_t sequence;
+        json id;
+        Handler handler;
+        CancellationToken token;
+    };
+
+    /// A response that has not been written yet.
+    struct PendingResponse {
+        /// The class of the request, or none for responses given to `respond`.
+        std::optional<Priority> priority;
+        bool completed = false;
+        std::optional<json> response;
+    };
+
+    void run();
+    void write_responses();
+    /// Records the outcome of a request. Must be called with the mutex held.
+    void complete(uint64_t sequence, std::optional<json> response);
+    /// Returns the next response that may be written, or the end of
+    /// `m_pending`. Must be called with the mutex held.
+    std::map<uint64_t, PendingResponse>::iterator find_writable();
+
+    Write m_write;
+
+    std::mutex m_mutex;
+    std::condition_variable m_task_ready;
+    std::condition_variable m_response_ready;
+    /// The waiting requests of each priority class, in submission order.
+    std::deque<Task> m_tasks[2];
+    /// The sequence number of the next request to be submitted.
+    uint64_t m_next_sequence = 0;
+    /// The responses that have not been written, by sequence number.
+    std::map<uint64_t, PendingResponse> m_pending;
+    /// The tokens of the submitted requests that have not finished, by id.
+    std::map<json, CancellationToken> m_in_flight;
+    bool m_stop = false;
+    bool m_stop_writing = false;
+
+    std::vector<std::thread> m_threads;
+    std::thread m_writer;
+};
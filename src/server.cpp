@@ -0,0 +1,1291 @@
+#include "server.hpp"
+
+#include <glslang/Public/ResourceLimits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "astsymbols.hpp"
+#include "completion.hpp"
+#include "includer.hpp"
+#include "infolog.hpp"
+#include "utils.hpp"
+
+namespace fs = std::filesystem;
+
+void send_message(AppState& appstate, std::string_view message)
+{
+    if (appstate.discard_output) return;
+
+    std::lock_guard<std::mutex> lock{appstate.output_mutex};
+    const char* data = message.data();
+    size_t remaining = message.size();
+    while (remaining > 0) {
+        ssize_t written = write(appstate.output_fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data += written;
+        remaining -= written;
+    }
+
+    if (appstate.verbose) {
+        write_log(appstate, "<<< Sending message: \n{}\n\n", message);
+    }
+}
+
+bool isolate_output(AppState& appstate)
+{
+    std::fflush(stdout);
+    int output_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+    if (output_fd < 0) return false;
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+        if (null_fd >= 0) close(null_fd);
+        close(output_fd);
+        return false;
+    }
+    close(null_fd);
+    appstate.output_fd = output_fd;
+    return true;
+}
+
+void send_response(AppState& appstate, json response)
+{
+    thread_local std::string buffer;
+    std::string_view message;
+    {
+        ScopedTimer timer{appstate.stage_histograms.serialize};
+        message = make_response(std::move(response), buffer, appstate.pretty_print);
+    }
+    send_message(appstate, message);
+}
+
+EShLanguage find_language(const std::string& name)
+{
+    // As well as the one used in glslang, there are a number of different conventions used for naming GLSL shaders.
+    // This function attempts to support the most common ones, by checking if the filename ends with one of a list of known extensions.
+    // If a ".glsl" extension is found initially, it is first removed to allow for e.g. vs.glsl/vert.glsl naming.
+    auto path = fs::path(name);
+    auto ext_path = path.extension();
+    if (ext_path == ".glsl")
+        ext_path = path.replace_extension();
+
+    const auto ext = ext_path.string();
+
+    if (ext.ends_with("vert") || ext.ends_with("vs") || ext.ends_with("vsh"))
+        return EShLangVertex;
+    else if (ext.ends_with("tesc"))
+        return EShLangTessControl;
+    else if (ext.ends_with("tese"))
+        return EShLangTessEvaluation;
+    else if (ext.ends_with("geom") || ext.ends_with("gs") || ext.ends_with("gsh"))
+        return EShLangGeometry;
+    else if (ext.ends_with("frag") || ext.ends_with("fs") || ext.ends_with("fsh"))
+        return EShLangFragment;
+    else if (ext.ends_with("comp"))
+        return EShLangCompute;
+    throw std::invalid_argument("Unknown file extension!");
+}
+
+/// Hashes what a parse depends on besides the text itself: the target
+/// environment, and the uris and content hashes of the included files.
+uint64_t hash_environment(const std::map<std::string, uint64_t>& includes, const TargetVersions& target)
+{
+    uint64_t hash = hash_bytes(fmt::format("{} {} {} {}", int(target.client_api), int(target.client_api_version),
+            int(target.spv_version), unsigned(target.options)));
+    for (const auto& [include, content_hash] : includes) {
+        hash = hash_bytes(include, hash);
+        hash = hash_bytes(std::string_view(reinterpret_cast<const char*>(&content_hash), sizeof(content_hash)), hash);
+    }
+    return hash;
+}
+
+/// Hashes the environment a parse would see now, given the files it includes.
+uint64_t hash_environment(const std::set<std::string>& includes, AppState& appstate)
+{
+    auto workspace = appstate.workspace.snapshot();
+    std::map<std::string, uint64_t> contents;
+    for (const auto& include : includes) {
+        auto document = get_file_document(include, *workspace, appstate);
+        contents.emplace(include, document ? document->content_hash() : 0);
+    }
+    return hash_environment(contents, appstate.target);
+}
+
+json get_diagnostics(const std::string& uri, const Document& content,
+        AppState& appstate, const CancellationToken& token)
+{
+    token.check();
+    ScopedTimer timer{appstate.stage_histograms.diagnostics};
+
+    // Unless the text changed, which changes the key anyway, the parse will
+    // include the same files as the last one did.
+    AnalysisKey key{ uri, content.content_hash(), hash_environment(appstate.workspace.includes(uri), appstate) };
+    if (auto analysis = appstate.analysis_cache.get(key)) {
+        content.set_parsed_symbols(analysis->symbols);
+        appstate.workspace.set_includes(uri, analysis->includes);
+        if (appstate.verbose) {
+            write_log(appstate, "Reusing the analysis of {}\n", uri);
+        }
+        return analysis->diagnostics;
+    }
+
+    auto document = uri;
+    auto lang = find_language(document);
+
+    glslang::TShader shader(lang);
+
+    auto target = appstate.target;
+
+    if (target.options & EShMsgSpvRules) {
+        if (target.options & EShMsgVulkanRules) {
+            shader.setEnvInput((target.options & EShMsgReadHlsl) ? glslang::EShSourceHlsl
+                                                           : glslang::EShSourceGlsl,
+                                lang, glslang::EShClientVulkan, 100);
+            shader.setEnvClient(glslang::EShClientVulkan, target.client_api_version);
+            shader.setEnvTarget(glslang::EShTargetSpv, target.spv_version);
+        } else {
+            shader.setEnvInput((target.options & EShMsgReadHlsl) ? glslang::EShSourceHlsl
+                                                           : glslang::EShSourceGlsl,
+                                lang, glslang::EShClientOpenGL, 100);
+            shader.setEnvClient(glslang::EShClientOpenGL, target.client_api_version);
+            shader.setEnvTarget(glslang::EshTargetSpv, target.spv_version);
+        }
+    }
+
+    auto shader_cstring = content.text().c_str();
+    auto shader_name = document.c_str();
+    shader.setStringsWithLengthsAndNames(&shader_cstring, nullptr, &shader_name, 1);
+
+    FileIncluder includer{&appstate.workspace, &appstate.include_cache};
+
+    TBuiltInResource Resources = *GetDefaultResources();
+    EShMessages messages =
+      (EShMessages)(EShMsgCascadingErrors | target.options);
+    {
+        ScopedTimer timer{appstate.stage_histograms.parse};
+        shader.parse(&Resources, 110, false, messages, includer);
+    }
+    std::string debug_log = shader.getInfoLog();
+
+    appstate.workspace.set_includes(uri, includer.included_files());
+    token.check();
+
+    // The syntax tree of the parse serves the symbol requests for this
+    // version, instead of scanning the text again for each of them.
+    auto analysis = std::make_shared<Analysis>();
+    analysis->includes = includer.included_files();
+#ifdef HAVE_PARSED_SYMBOLS
+    if (auto intermediate = shader.getIntermediate()) {
+        ScopedTimer timer{appstate.stage_histograms.parsed_symbols};
+        auto workspace = appstate.workspace.snapshot();
+        analysis->symbols = extract_parsed_symbols(*intermediate, uri, content, includer.include_order(),
+                [&](const std::string& file) { return get_file_document(file, *workspace, appstate); }, token);
+        content.set_parsed_symbols(analysis->symbols);
+    }
+#endif
+
+    if (appstate.verbose) {
+        write_log(appstate, "Diagnostics raw output: {}\n" , debug_log);
+    }
+
+    json diagnostics;
+    for_each_info_log_message(debug_log, [&](const InfoLogMessage& error) {
+        token.check();
+        if (error.file != document) return; // message is for another file
+
+        json diagnostic;
+        int severity_no = -1;
+        if (error.severity == "ERROR") {
+            severity_no = 1;
+        } else if (error.severity == "WARNING") {
+            severity_no = 2;
+        }
+        if (severity_no == -1) {
+            write_log(appstate, "Error: Unknown severity '{}'\n", error.severity);
+        }
+
+        // -1 because lines are 0-indexed as per LSP specification.
+        int line_no = error.line - 1;
+        const LineIndex& line_index = content.line_index();
+        std::string_view source_line = line_index.line(line_no);
+
+        int start_char = -1;
+        int end_char = -1;
+
+        // If this is an undeclared identifier, we can find the exact
+        // position of the broken identifier.
+        if (auto identifier = find_message_identifier(error.message)) {
+            auto source_pos = source_line.find(*identifier);
+            start_char = source_pos;
+            end_char = source_pos + identifier->length() - 1;
+            if (source_pos != std::string_view::npos) {
+                start_char = line_index.character(line_no, source_pos);
+                end_char = line_index.character(line_no, source_pos + identifier->length()) - 1;
+            }
+        } else {
+            // If we can't find a precise position, we'll just use the whole line.
+            start_char = 0;
+            end_char = line_index.character(line_no, source_line.length());
+        }
+
+        json range{
+            {"start", {
+                { "line", line_no },
+                { "character", start_char },
+            }},
+            { "end", {
+                { "line", line_no },
+                { "character", end_char },
+            }},
+        };
+        diagnostic["range"] = range;
+        diagnostic["severity"] = severity_no;
+        diagnostic["source"] = "glslang";
+        diagnostic["message"] = error.message;
+        diagnostics.push_back(diagnostic);
+    });
+    if (appstate.use_logfile && appstate.verbose && !diagnostics.empty()) {
+        write_log(appstate, "Sending diagnostics: {}\n" , diagnostics.dump(4));
+    }
+
+    analysis->diagnostics = diagnostics;
+    // The key only covers the files that were included, so a parse that
+    // failed to include a file would be reused after the file appears.
+    if (includer.missing_files().empty()) {
+        // Hash what the parse actually saw, since the includes may have
+        // changed since.
+        key.environment_hash = hash_environment(includer.included_contents(), appstate.target);
+        appstate.analysis_cache.put(key, std::move(analysis));
+    }
+    return diagnostics;
+}
+
+std::shared_ptr<const BuiltinSymbols> get_builtin_symbols(const std::string& uri, AppState& appstate)
+{
+    BuiltinSymbolsKey key{};
+    key.language = find_language(uri);
+    // use the highest known version so that we get as many symbols as possible
+    key.version = 460;
+    // same thing here: use compatibility profile for more symbols
+    key.profile = ECompatibilityProfile;
+    key.spv_version = appstate.target.spv_version;
+    return get_builtin_symbols(key);
+}
+
+SymbolSet get_symbols(const std::string& uri, const WorkspaceSnapshot& workspace, AppState& appstate){
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto builtins = get_builtin_symbols(uri, appstate);
+    SymbolSet symbols;
+    symbols.builtins = std::shared_ptr<const SymbolTable>(builtins, &builtins->symbols);
+    auto document = workspace.get_document(uri);
+    if (document) symbols.locals = document->parsed_symbols();
+    if (!symbols.locals && document) {
+        // The current version has not been parsed yet, so fall back to
+        // scanning the text, once per version.
+        ScopedTimer timer{appstate.stage_histograms.extract_symbols};
+        symbols.locals = document->scanned_symbols(intern_uri(uri));
+    }
+    if (!symbols.locals) symbols.locals = std::make_shared<SymbolTable>();
+
+    if (appstate.verbose) {
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        write_log(appstate, "Resolved symbols for {} in {} us\n", uri,
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    return symbols;
+}
+
+/// Returns the best `limit` completions for `prefix`, ordered from best to
+/// worst. Sets `is_incomplete` if there were more matches than that.
+std::vector<CompletionMatch> find_completions(const SymbolSet& symbols, const CompletionIndex& builtin_index,
+        const std::string& prefix, size_t limit, bool& is_incomplete)
+{
+    std::vector<CompletionMatch> matches;
+    builtin_index.find(prefix, matches);
+    size_t builtin_count = matches.size();
+    CompletionIndex(*symbols.locals).find(prefix, matches);
+
+    // Builtins take precedence over document symbols with the same name.
+    auto shadowed = std::remove_if(matches.begin() + builtin_count, matches.end(), [&](const CompletionMatch& match) {
+        return symbols.builtins->contains(match.name);
+    });
+    matches.erase(shadowed, matches.end());
+
+    is_incomplete = matches.size() > limit;
+    if (is_incomplete) {
+        std::partial_sort(matches.begin(), matches.begin() + limit, matches.end());
+        matches.resize(limit);
+    } else {
+        std::sort(matches.begin(), matches.end());
+    }
+    return matches;
+}
+
+json get_completions(const std::string &uri, int line, int character, const WorkspaceSnapshot& workspace,
+        AppState& appstate, const CancellationToken& token)
+{
+    auto snapshot = workspace.get_document(uri);
+    if (!snapshot) return nullptr;
+    const std::string& document = snapshot->text();
+    int offset = snapshot->line_index().offset(line, character);
+    int word_start = get_last_word_start(document.c_str(), offset);
+    int length = offset - word_start;
+
+    if (length <= 0) {
+        // no word under the cursor.
+        return nullptr;
+    }
+
+    auto name = document.substr(word_start, length);
+
+    auto builtins = get_builtin_symbols(uri, appstate);
+    auto symbols = get_symbols(uri, workspace, appstate);
+    token.check();
+    bool is_incomplete = false;
+    auto matches = find_completions(symbols, builtins->completion_index, name,
+            appstate.max_completions, is_incomplete);
+
+    // Clients sort by `sortText`, so keep our ranking by numbering the items.
+    json items = json::array();
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Symbol& symbol = *matches[i].symbol;
+        items.push_back(json {
+            { "label", matches[i].name },
+            { "kind", symbol.kind == Symbol::Unknown ? json(nullptr) : json(symbol.kind) },
+            { "detail", symbol.details },
+            { "sortText", fmt::format("{:05}", i) },
+        });
+    }
+
+    if (appstate.verbose) {
+        write_log(appstate, "Completion for '{}': {} items ({}), {} bytes\n", name, items.size(),
+                is_incomplete ? "truncated" : "complete", items.dump().size());
+    }
+
+    // Reporting truncated results as incomplete makes the client ask again as
+    // the prefix grows, instead of filtering our partial list.
+    return json {
+        { "isIncomplete", is_incomplete },
+        { "items", items },
+    };
+}
+
+std::optional<std::string> get_word_under_cursor(
+        const std::string& uri, 
+        int line, int character, 
+        const WorkspaceSnapshot& workspace) 
+{
+    auto snapshot = workspace.get_document(uri);
+    if (!snapshot) return std::nullopt;
+    const std::string& document = snapshot->text();
+    int offset = snapshot->line_index().offset(line, character);
+    int word_start = get_last_word_start(document.c_str(), offset);
+    int word_end = get_word_end(document.c_str(), word_start);
+    int length = word_end - word_start;
+
+    if (length <= 0) {
+        // no word under the cursor.
+        return std::nullopt;
+    }
+
+    return document.substr(word_start, length);
+}
+
+json get_hover_info(const std::string& uri, int line, int character, const WorkspaceSnapshot& workspace,
+        AppState& appstate) {
+    auto word = get_word_under_cursor(uri, line, character, workspace);
+    if (!word) return nullptr;
+
+    auto symbols = get_symbols(uri, workspace, appstate);
+    auto symbol = symbols.find(*word);
+    if (!symbol) return nullptr;
+
+    return json {
+        { "contents", { 
+            { "language", "glsl" }, 
+            { "value", symbol->details } 
+        } }
+    };
+}
+
+std::optional<Document> get_file_document(const std::string& uri, const WorkspaceSnapshot& workspace,
+        AppState& appstate)
+{
+    if (auto document = workspace.get_document(uri)) return document;
+    if (auto path = strip_prefix("file://", uri.c_str())) return appstate.include_cache.get(path);
+    return std::nullopt;
+}
+
+/// Looks up a definition in the workspace symbol index, for symbols that are
+/// not defined in the document itself.
+std::optional<IndexedSymbol> find_indexed_definition(const std::string& name, AppState& appstate)
+{
+    if (!appstate.symbol_index) return std::nullopt;
+    auto results = appstate.symbol_index->find(name);
+    if (results.empty()) return std::nullopt;
+    return std::move(results.front());
+}
+
+json get_definition(const std::string& uri, int line, int character, const WorkspaceSnapshot& workspace,
+        AppState& appstate) {
+    auto word = get_word_under_cursor(uri, line, character, workspace);
+    if (!word) return nullptr;
+
+    std::string symbol_uri;
+    int symbol_offset = -1;
+
+    auto symbols = get_symbols(uri, workspace, appstate);
+    auto symbol = symbols.find(*word);
+    if (symbol && symbol->location.has_uri()) {
+        symbol_uri = get_uri(symbol->location.uri);
+        symbol_offset = symbol->location.offset;
+    } else if (symbol) {
+        return nullptr; // a builtin
+    } else if (auto indexed = find_indexed_definition(*word, appstate)) {
+        symbol_uri = std::move(indexed->uri);
+        symbol_offset = indexed->offset;
+    } else {
+        return nullptr;
+    }
+
+    auto document = get_file_document(symbol_uri, workspace, appstate);
+    if (!document) return nullptr;
+    auto position = document->line_index().position(symbol_offset);
+    int length = word->size();
+
+    json start {
+        { "line", position.line },
+        { "character", position.character },
+    };
+    json end {
+        { "line", position.line },
+        { "character", position.character + length },
+    };
+    return json {
+        { "uri", symbol_uri },
+        { "range", { { "start", start }, { "end", end } } },
+    };
+}
+
+json make_range(SourceFileLocation start, int length)
+{
+    return json {
+        { "start", { { "line", start.line }, { "character", start.character } } },
+        { "end", { { "line", start.line }, { "character", start.character + length } } },
+    };
+}
+
+/// The most including documents searched for references to a header.
+static const size_t MAX_REFERENCE_DEPENDENTS = 32;
+
+/// Returns the files whose identifiers may refer to the same symbols as the
+/// given document: the document, the files it includes, and the open
+/// documents including it along with their own includes.
+std::set<std::string> get_related_files(const std::string& uri, const WorkspaceSnapshot& workspace)
+{
+    std::set<std::string> files = workspace.includes(uri);
+    files.insert(uri);
+    for (const auto& dependent : workspace.open_dependents(uri, MAX_REFERENCE_DEPENDENTS)) {
+        files.merge(workspace.includes(dependent));
+        files.insert(dependent);
+    }
+    return files;
+}
+
+json get_references(const std::string& uri, int line, int character, bool include_declaration,
+        const WorkspaceSnapshot& workspace, AppState& appstate, const CancellationToken& token)
+{
+    json result = json::array();
+    auto word = get_word_under_cursor(uri, line, character, workspace);
+    if (!word) return result;
+
+    // The declaration is the definition found in the document itself, if any.
+    std::string declaration_uri;
+    int declaration_offset = -1;
+    if (!include_declaration) {
+        auto symbols = get_symbols(uri, workspace, appstate);
+        if (auto symbol = symbols.find(*word); symbol && symbol->location.has_uri()) {
+            declaration_uri = get_uri(symbol->location.uri);
+            declaration_offset = symbol->location.offset;
+        }
+    }
+
+    for (const auto& file : get_related_files(uri, workspace)) {
+        token.check();
+        auto document = get_file_document(file, workspace, appstate);
+        if (!document) continue;
+
+        for (uint32_t offset : document->occurrences().find(*word)) {
+            if (file == declaration_uri && int(offset) == declaration_offset) continue;
+            auto position = document->line_index().position(offset);
+            result.push_back(json {
+                { "uri", file },
+                { "range", make_range(position, word->size()) },
+            });
+        }
+    }
+    return result;
+}
+
+json get_document_highlights(const std::string& uri, int line, int character,
+        const WorkspaceSnapshot& workspace)
+{
+    json result = json::array();
+    auto word = get_word_under_cursor(uri, line, character, workspace);
+    if (!word) return result;
+
+    auto document = workspace.get_document(uri);
+    if (!document) return result;
+
+    for (uint32_t offset : document->occurrences().find(*word)) {
+        auto position = document->line_index().position(offset);
+        result.push_back(json {
+            { "range", make_range(position, word->size()) },
+            { "kind", 1 }, // Text
+        });
+    }
+    return result;
+}
+
+/// The most results returned for a `workspace/symbol` query.
+static const size_t MAX_WORKSPACE_SYMBOLS = 256;
+
+/// Returns the LSP `SymbolKind` for a symbol.
+int get_symbol_kind(Symbol::Kind kind)
+{
+    switch (kind) {
+        case Symbol::Function: return 12;
+        case Symbol::Type: return 23; // Struct
+        case Symbol::Constant: return 14;
+        default: return 13; // Variable
+    }
+}
+
+json get_workspace_symbols(const std::string& query, AppState& appstate, const CancellationToken& token)
+{
+    json result = json::array();
+    if (!appstate.symbol_index) return result;
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto symbols = appstate.symbol_index->search(query, MAX_WORKSPACE_SYMBOLS);
+    token.check();
+    for (const auto& symbol : symbols) {
+        json start {
+            { "line", symbol.position.line },
+            { "character", symbol.position.character },
+        };
+        json end {
+            { "line", symbol.position.line },
+            { "character", symbol.position.character + int(symbol.name.size()) },
+        };
+        result.push_back(json {
+            { "name", symbol.name },
+            { "kind", get_symbol_kind(symbol.kind) },
+            { "location", {
+                { "uri", symbol.uri },
+                { "range", { { "start", start }, { "end", end } } },
+            } },
+        });
+    }
+
+    if (appstate.verbose) {
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        write_log(appstate, "Workspace symbols for '{}': {} results in {} us\n", query, result.size(),
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+    return result;
+}
+
+json make_diagnostics_notification(const std::string& uri, int version, json diagnostics)
+{
+    if (diagnostics.empty()) {
+        diagnostics = json::array();
+    }
+    json result_body{
+        { "method", "textDocument/publishDiagnostics" },
+        { "params", {
+                        { "uri", uri },
+                        { "version", version },
+                        { "diagnostics", diagnostics },
+                    } }
+    };
+    return result_body;
+}
+
+/// Recomputes the diagnostics for a document after it has changed. If
+/// diagnostics are computed in the background, the result is published later
+/// and nothing is returned.
+std::optional<json> update_diagnostics(const std::string& uri, AppState& appstate)
+{
+    auto document = appstate.workspace.get_document(uri);
+    if (!document) return std::nullopt;
+
+    if (appstate.diagnostics_worker) {
+        appstate.diagnostics_worker->schedule(uri, std::move(*document));
+        return std::nullopt;
+    }
+
+    json diagnostics = get_diagnostics(uri, *document, appstate);
+    return make_diagnostics_notification(uri, document->version(), std::move(diagnostics));
+}
+
+std::string default_cache_dir()
+{
+    if (const char* cache_home = std::getenv("XDG_CACHE_HOME"); cache_home && *cache_home) {
+        return (fs::path(cache_home) / "glslls").string();
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return (fs::path(home) / ".cache" / "glslls").string();
+    }
+    return "";
+}
+
+/// Reads the workspace folders from the `initialize` parameters, along with
+/// whether the client can display progress.
+void read_workspace_params(const json& params, AppState& appstate)
+{
+    if (!params.is_object()) return;
+
+    if (params.contains("workspaceFolders") && params["workspaceFolders"].is_array()) {
+        for (const auto& folder : params["workspaceFolders"]) {
+            if (folder.is_object() && folder.contains("uri") && folder["uri"].is_string()) {
+                appstate.workspace_roots.push_back(folder["uri"]);
+            }
+        }
+    }
+    if (appstate.workspace_roots.empty()) {
+        if (params.contains("rootUri") && params["rootUri"].is_string()) {
+            appstate.workspace_roots.push_back(params["rootUri"]);
+        } else if (params.contains("rootPath") && params["rootPath"].is_string()) {
+            appstate.workspace_roots.push_back(make_path_uri(params["rootPath"]));
+        }
+    }
+
+    appstate.client_supports_progress = params.contains("capabilities")
+        && params["capabilities"].value("/window/workDoneProgress"_json_pointer, false);
+}
+
+/// Opens the symbol index for the workspace. It is persistent if there is a
+/// cache directory, and each workspace has an index of its own.
+void open_symbol_index(AppState& appstate)
+{
+    if (appstate.workspace_roots.empty()) return;
+
+    fs::path path;
+    if (!appstate.cache_dir.empty()) {
+        uint64_t roots_hash = 0;
+        for (const auto& root : appstate.workspace_roots) {
+            roots_hash = hash_bytes(root, roots_hash ^ 0xcbf29ce484222325);
+        }
+        path = fs::path(appstate.cache_dir) / fmt::format("{:016x}.index", roots_hash);
+    }
+
+    appstate.symbol_index = std::make_unique<SymbolIndex>(path);
+    write_log(appstate, "Loaded symbol index from '{}': {} files\n",
+            path.string(), appstate.symbol_index->file_count());
+}
+
+/// Returns `true` for files that should be indexed: shaders, and files with
+/// the generic extension used for shared headers.
+bool is_indexable_file(const fs::path& path)
+{
+    if (path.extension() == ".glsl") return true;
+    if (path.extension().empty()) return false;
+    try {
+        find_language(path.string());
+        return true;
+    } catch (const std::invalid_argument&) {
+        return false;
+    }
+}
+
+/// Files larger than this are skipped by the workspace indexer.
+static const uintmax_t MAX_INDEXED_FILE_SIZE = 4 * 1024 * 1024;
+
+/// Returns all indexable files below the given roots, skipping hidden directories.
+std::vector<fs::path> find_indexable_files(const std::vector<std::string>& roots)
+{
+    std::vector<fs::path> files;
+    for (const auto& root : roots) {
+        auto root_path = strip_prefix("file://", root.c_str());
+        if (!root_path) continue;
+
+        std::error_code error;
+        fs::recursive_directory_iterator it{root_path, fs::directory_options::skip_permission_denied, error};
+        for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            const auto& entry = *it;
+            if (entry.path().filename().string().starts_with(".")) {
+                if (entry.is_directory(error)) it.disable_recursion_pending();
+                continue;
+            }
+            if (entry.is_regular_file(error) && is_indexable_file(entry.path())
+                    && entry.file_size(error) <= MAX_INDEXED_FILE_SIZE) {
+                files.push_back(entry.path());
+            }
+        }
+    }
+    return files;
+}
+
+void send_progress(AppState& appstate, const std::string& token, json value)
+{
+    send_response(appstate, json{
+        { "method", "$/progress" },
+        { "params", { { "token", token }, { "value", std::move(value) } } },
+    });
+}
+
+/// Shared by the tasks of one indexing pass.
+struct IndexingProgress {
+    std::string token;
+    bool report = false;
+    size_t total = 0;
+    std::atomic<size_t> done = 0;
+    std::atomic<int> reported_percent = 0;
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+};
+
+/// Called by the indexing tasks after each file.
+void finish_indexed_file(const std::shared_ptr<IndexingProgress>& progress, AppState& appstate)
+{
+    size_t done = progress->done.fetch_add(1) + 1;
+
+    if (done == progress->total) {
+        appstate.symbol_index->save();
+        auto elapsed = std::chrono::steady_clock::now() - progress->start_time;
+        write_log(appstate, "Indexed {} files in {} ms on {} threads\n", progress->total,
+                std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+                appstate.index_pool->thread_count());
+        if (progress->report) {
+            send_progress(appstate, progress->token, json{ { "kind", "end" } });
+        }
+        return;
+    }
+
+    // Only report whole percentages, and each of them once.
+    int percent = done * 100 / progress->total;
+    int reported = progress->reported_percent.load();
+    if (progress->report && percent > reported
+            && progress->reported_percent.compare_exchange_strong(reported, percent)) {
+        send_progress(appstate, progress->token, json{
+            { "kind", "report" },
+            { "message", fmt::format("{}/{} files", done, progress->total) },
+            { "percentage", percent },
+        });
+    }
+}
+
+/// Indexes the symbols of all shaders in the workspace on the indexing
+/// threads, reporting progress to the client if it supports that.
+void start_workspace_indexing(AppState& appstate)
+{
+    if (!appstate.index_pool || !appstate.symbol_index) return;
+
+    auto progress = std::make_shared<IndexingProgress>();
+    progress->token = "glslls/indexing";
+    progress->report = appstate.client_supports_progress;
+    if (progress->report) {
+        send_response(appstate, json{
+            { "id", progress->token },
+            { "method", "window/workDoneProgress/create" },
+            { "params", { { "token", progress->token } } },
+        });
+        send_progress(appstate, progress->token, json{
+            { "kind", "begin" },
+            { "title", "Indexing" },
+            { "cancellable", false },
+            { "percentage", 0 },
+        });
+    }
+
+    // Walking the tree may take a while as well, so do it in the background too.
+    appstate.index_pool->submit([&appstate, progress] {
+        // A damaged index is discarded before the files are compared with it.
+        if (!appstate.symbol_index->verify()) {
+            write_log(appstate, "The symbol index was damaged and is rebuilt\n");
+        }
+        auto files = find_indexable_files(appstate.workspace_roots);
+        progress->total = files.size();
+        if (files.empty()) {
+            if (progress->report) {
+                send_progress(appstate, progress->token, json{ { "kind", "end" } });
+            }
+            return;
+        }
+
+        for (auto& path : files) {
+            appstate.index_pool->submit([&appstate, progress, path = std::move(path)] {
+                if (auto contents = read_file_to_string(path.c_str())) {
+                    appstate.symbol_index->update("file://" + path.string(), *contents);
+                }
+                finish_indexed_file(progress, appstate);
+            });
+        }
+    });
+}
+
+/// The most documents re-diagnosed in the background after a file they include
+/// has changed.
+static const size_t MAX_DEPENDENT_DIAGNOSTICS = 32;
+
+/// Schedules new diagnostics for the open documents including a file that has
+/// changed. This needs the background worker, since only one message can be
+/// returned otherwise.
+void update_dependent_diagnostics(const std::string& uri, AppState& appstate)
+{
+    if (!appstate.diagnostics_worker) return;
+
+    for (const auto& dependent : appstate.workspace.open_dependents(uri, MAX_DEPENDENT_DIAGNOSTICS)) {
+        if (auto document = appstate.workspace.get_document(dependent)) {
+            appstate.diagnostics_worker->schedule(dependent, std::move(*document));
+        }
+    }
+}
+
+std::map<std::string, LatencyHistogram*, std::less<>> make_method_histograms(Stats& stats)
+{
+    // The methods `dispatch_message` answers, plus messages without a method.
+    static const char* const methods[] = {
+        "initialize",
+        "initialized",
+        "textDocument/didOpen",
+        "textDocument/didSave",
+        "textDocument/didClose",
+        "textDocument/didChange",
+        "textDocument/completion",
+        "textDocument/hover",
+        "textDocument/documentHighlight",
+        "textDocument/definition",
+        "textDocument/references",
+        "workspace/symbol",
+        "$/cancelRequest",
+        "$/glslls/stats",
+        "(none)",
+        "(other)",
+    };
+    std::map<std::string, LatencyHistogram*, std::less<>> histograms;
+    for (const char* method : methods) {
+        histograms.emplace(method, &stats.histogram(fmt::format("method:{}", method)));
+    }
+    return histograms;
+}
+
+StageHistograms make_stage_histograms(Stats& stats)
+{
+    return StageHistograms{
+        stats.histogram("stage:queue"),
+        stats.histogram("stage:diagnostics"),
+        stats.histogram("stage:parse"),
+        stats.histogram("stage:parsed_symbols"),
+        stats.histogram("stage:extract_symbols"),
+        stats.histogram("stage:serialize"),
+    };
+}
+
+/// Returns the latency histogram of a method, without creating one for
+/// every method a client makes up.
+static LatencyHistogram& get_method_histogram(std::string_view method, AppState& appstate)
+{
+    auto it = appstate.method_histograms.find(method.empty() ? "(none)" : method);
+    if (it == appstate.method_histograms.end()) {
+        it = appstate.method_histograms.find("(other)");
+    }
+    return *it->second;
+}
+
+/// Returns the scheduling priority of a request that only reads the
+/// workspace, or nothing for messages that must be handled in order.
+std::optional<RequestScheduler::Priority> get_read_priority(const std::string& method)
+{
+    if (method == "textDocument/completion" || method == "textDocument/hover"
+            || method == "textDocument/documentHighlight" || method == "textDocument/definition") {
+        return RequestScheduler::Priority::Interactive;
+    }
+    if (method == "textDocument/references" || method == "workspace/symbol") {
+        return RequestScheduler::Priority::Background;
+    }
+    return std::nullopt;
+}
+
+/// Returns the id of a request, or null for notifications and malformed messages.
+static json get_request_id(const json& body)
+{
+    return body.is_object() ? body.value("id", json()) : json();
+}
+
+/// Answers a message that could not be handled with an error, unless it is a
+/// notification, which gets no reply.
+static std::optional<json> make_error_response(const json& body, int code, const std::string& message)
+{
+    if (!body.is_object() || !body.contains("id")) return std::nullopt;
+    json error{
+        { "code", code },
+        { "message", message },
+    };
+    return json{
+        { "id", body["id"] },
+        { "error", error },
+    };
+}
+
+/// Handles a request that only reads the workspace, as of the given snapshot.
+/// Throws `RequestCancelled` if `token` is cancelled before the work is done,
+/// and a `json::exception` if the parameters are missing or malformed.
+std::optional<json> dispatch_read_request(const json& body, const std::string& method,
+        const WorkspaceSnapshot& workspace, AppState& appstate, const CancellationToken& token)
+{
+    token.check();
+    if (method == "textDocument/completion") {
+        auto uri = body.at("params").at("textDocument").at("uri");
+        const json& position = body.at("params").at("position");
+        int line = position.at("line");
+        int character = position.at("character");
+
+        json completions = get_completions(uri, line, character, workspace, appstate, token);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", completions }
+        };
+        return result_body;
+    } else if (method == "textDocument/hover") {
+        auto uri = body.at("params").at("textDocument").at("uri");
+        const json& position = body.at("params").at("position");
+        int line = position.at("line");
+        int character = position.at("character");
+
+        json hover = get_hover_info(uri, line, character, workspace, appstate);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", hover }
+        };
+        return result_body;
+    } else if (method == "textDocument/references") {
+        auto uri = body.at("params").at("textDocument").at("uri");
+        const json& position = body.at("params").at("position");
+        int line = position.at("line");
+        int character = position.at("character");
+        bool include_declaration = body.value("/params/context/includeDeclaration"_json_pointer, true);
+
+        json result = get_references(uri, line, character, include_declaration, workspace, appstate, token);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", result }
+        };
+        return result_body;
+    } else if (method == "textDocument/documentHighlight") {
+        auto uri = body.at("params").at("textDocument").at("uri");
+        const json& position = body.at("params").at("position");
+        int line = position.at("line");
+        int character = position.at("character");
+
+        json result = get_document_highlights(uri, line, character, workspace);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", result }
+        };
+        return result_body;
+    } else if (method == "workspace/symbol") {
+        json result = get_workspace_symbols(body.value("/params/query"_json_pointer, ""), appstate, token);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", result }
+        };
+        return result_body;
+    } else if (method == "textDocument/definition") {
+        auto uri = body.at("params").at("textDocument").at("uri");
+        const json& position = body.at("params").at("position");
+        int line = position.at("line");
+        int character = position.at("character");
+
+        json result = get_definition(uri, line, character, workspace, appstate);
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", result }
+        };
+        return result_body;
+    }
+    return std::nullopt;
+}
+
+std::optional<json> dispatch_message(const json& body, const std::string& method, AppState& appstate)
+{
+
+    // Responses to our own requests, which need no reply.
+    if (method.empty() && body.is_object() && body.contains("id")
+            && (body.contains("result") || body.contains("error"))) {
+        return std::nullopt;
+    }
+
+    if (method == "initialized") {
+        start_workspace_indexing(appstate);
+        return std::nullopt;
+    }
+
+    if (method == "initialize") {
+        appstate.workspace.set_initialized(true);
+        read_workspace_params(body.value("params", json()), appstate);
+        open_symbol_index(appstate);
+
+        json text_document_sync{
+            { "openClose", true },
+            { "change", 2 }, // Incremental sync
+            { "willSave", false },
+            { "willSaveWaitUntil", false },
+            { "save", { { "includeText", false } } },
+        };
+
+        json completion_provider{
+            { "resolveProvider", false },
+            { "triggerCharacters", json::array() },
+        };
+        json signature_help_provider{
+            { "triggerCharacters", json::array() }
+        };
+        json code_lens_provider{
+            { "resolveProvider", false }
+        };
+        json document_on_type_formatting_provider{
+            { "firstTriggerCharacter", "" },
+            { "moreTriggerCharacter", json::array() },
+        };
+        json document_link_provider{
+            { "resolveProvider", false }
+        };
+        json execute_command_provider{
+            { "commands", json::array() }
+        };
+        json result{
+            {
+                "capabilities",
+                {
+                { "textDocumentSync", text_document_sync },
+                { "hoverProvider", true },
+                { "completionProvider", completion_provider },
+                { "signatureHelpProvider", signature_help_provider },
+                { "definitionProvider", true },
+                { "referencesProvider", true },
+                { "documentHighlightProvider", true },
+                { "documentSymbolProvider", false },
+                { "workspaceSymbolProvider", true },
+                { "codeActionProvider", false },
+                { "codeLensProvider", code_lens_provider },
+                { "documentFormattingProvider", false },
+                { "documentRangeFormattingProvider", false },
+                { "documentOnTypeFormattingProvider", document_on_type_formatting_provider },
+                { "renameProvider", false },
+                { "documentLinkProvider", document_link_provider },
+                { "executeCommandProvider", execute_command_provider },
+                { "experimental", {} }, }
+            }
+        };
+
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", result }
+        };
+        return result_body;
+    } else if (method == "textDocument/didOpen") {
+        const auto& text_document = body.at("params").at("textDocument");
+        const auto& uri = text_document.at("uri").get_ref<const std::string&>();
+        const auto& text = text_document.at("text").get_ref<const std::string&>();
+        appstate.workspace.open_document(uri, text, text_document.value("version", 0));
+        if (appstate.symbol_index) {
+            appstate.symbol_index->update(uri, text);
+        }
+
+        return update_diagnostics(uri, appstate);
+    } else if (method == "textDocument/didSave") {
+        const auto& uri = body.at("params").at("textDocument").at("uri").get_ref<const std::string&>();
+        auto document = appstate.workspace.get_document(uri);
+        // The index is written to disk on shutdown, not on every save.
+        if (document && appstate.symbol_index) {
+            appstate.symbol_index->update(uri, document->text());
+        }
+        return std::nullopt;
+    } else if (method == "textDocument/didClose") {
+        const auto& uri = body.at("params").at("textDocument").at("uri").get_ref<const std::string&>();
+        appstate.workspace.remove_document(uri);
+        return std::nullopt;
+    } else if (method == "textDocument/didChange") {
+        const auto& text_document = body.at("params").at("textDocument");
+        const auto& uri = text_document.at("uri").get_ref<const std::string&>();
+        int version = text_document.value("version", 0);
+
+        // Changes are applied in order. A change without a range replaces the
+        // whole document.
+        for (const auto& change : body.at("params").at("contentChanges")) {
+            const auto& text = change.at("text").get_ref<const std::string&>();
+            if (change.contains("range")) {
+                const auto& range = change.at("range");
+                SourceFileLocation start{ range.at("start").at("line"), range.at("start").at("character") };
+                SourceFileLocation end{ range.at("end").at("line"), range.at("end").at("character") };
+                appstate.workspace.change_document(uri, start, end, text, version);
+            } else {
+                appstate.workspace.change_document(uri, text, version);
+            }
+        }
+
+        // The workspace index follows the file on disk, so it is updated on
+        // save rather than on every keystroke.
+        update_dependent_diagnostics(uri, appstate);
+        return update_diagnostics(uri, appstate);
+    } else if (method == "$/glslls/stats") {
+        json result_body{
+            { "id", get_request_id(body) },
+            { "result", appstate.stats.to_json() }
+        };
+        result_body["result"]["analysis_cache"] = appstate.analysis_cache.stats();
+        return result_body;
+    } else if (get_read_priority(method)) {
+        return dispatch_read_request(body, method, *appstate.workspace.snapshot(), appstate, CancellationToken());
+    }
+
+
+    // If the workspace has not yet been initialized but the client sends a
+    // message that doesn't have method "initialize" then we'll return an error
+    // as per LSP spec.
+    if (method != "initialize" && !appstate.workspace.is_initialized()) {
+        json error{
+            { "code", -32002 },
+            { "message", "Server not yet initialized." },
+        };
+        json result_body{
+            { "error", error }
+        };
+        return result_body;
+    }
+
+    // If we don't know the method requested, we end up here.
+    if (body.count("method") == 1) {
+        // Requests have an ID field, but notifications do not.
+        bool is_notification = body.find("id") == body.end();
+        if (is_notification) {
+            // We don't have to respond to notifications. So don't error on
+            // notifications we don't recognize.
+            // https://microsoft.github.io/language-server-protocol/specifications/specification-3-15/#notificationMessage
+            return std::nullopt;
+        }
+
+        json error{
+            { "code", -32601 },
+            { "message", fmt::format("Method '{}' not supported.", method) },
+        };
+        json result_body{
+            { "id", get_request_id(body) },
+            { "error", error },
+        };
+        return result_body;
+    }
+
+    // If we couldn't parse anything we end up here.
+    json error{
+        { "code", -32700 },
+        { "message", "Couldn't parse message." },
+    };
+    json result_body{
+        { "error", error }
+    };
+    return result_body;
+}
+
+std::optional<json> handle_message(const MessageBuffer& message_buffer, AppState& appstate)
+{
+    const json& body = message_buffer.body();
+    const std::string method = body.is_object() ? body.value("method", "") : "";
+
+    ScopedTimer timer{get_method_histogram(method, appstate)};
+    try {
+        return dispatch_message(body, method, appstate);
+    } catch (const json::exception& e) {
+        write_log(appstate, "Error: Invalid parameters for '{}': {}\n", method, e.what());
+        return make_error_response(body, -32602, e.what()); // InvalidParams
+    } catch (const std::exception& e) {
+        write_log(appstate, "Error: Failed to handle '{}': {}\n", method, e.what());
+        return make_error_response(body, -32603, e.what()); // InternalError
+    }
+}
+
+void schedule_message(const MessageBuffer& message_buffer, AppState& appstate)
+{
+    const json& body = message_buffer.body();
+    const std::string method = body.is_object() ? body.value("method", "") : "";
+
+    if (method == "$/cancelRequest" && appstate.scheduler) {
+        // Cancellations of requests that already finished, or that can not
+        // be identified, are ignored.
+        const json id = body.value("/params/id"_json_pointer, json());
+        if (!id.is_null()) {
+            appstate.scheduler->cancel(id);
+        }
+        return;
+    }
+
+    auto priority = appstate.scheduler ? get_read_priority(method) : std::nullopt;
+    if (!priority) {
+        auto response = handle_message(message_buffer, appstate);
+        if (!response) return;
+        if (appstate.scheduler) {
+            appstate.scheduler->respond(std::move(*response));
+        } else {
+            send_response(appstate, std::move(*response));
+        }
+        return;
+    }
+
+    // Changes handled while the request waits do not affect its snapshot.
+    auto workspace = appstate.workspace.snapshot();
+    auto queued = std::chrono::steady_clock::now();
+    appstate.scheduler->submit(*priority, get_request_id(body), [body, method, workspace, queued, &appstate](
+            const CancellationToken& token) -> std::optional<json> {
+        appstate.stage_histograms.queue.record(std::chrono::steady_clock::now() - queued);
+        ScopedTimer timer{get_method_histogram(method, appstate)};
+        try {
+            return dispatch_read_request(body, method, *workspace, appstate, token);
+        } catch (const RequestCancelled&) {
+            throw;
+        } catch (const json::exception& e) {
+            write_log(appstate, "Error: Invalid parameters for '{}': {}\n", method, e.what());
+            return make_error_response(body, -32602, e.what()); // InvalidParams
+        } catch (const std::exception& e) {
+            write_log(appstate, "Error: Failed to handle '{}': {}\n", method, e.what());
+            return make_error_response(body, -32603, e.what()); // InternalError
+        }
+    });
+}
+
+void log_received_message(const MessageBuffer& message_buffer, AppState& appstate)
+{
+    if (!appstate.use_logfile) return;
+
+    const json& body = message_buffer.body();
+    write_log(appstate, ">>> Received message of type '{}'\n", body.is_object() ? body.value("method", "") : "");
+    if (appstate.verbose) {
+        std::string headers;
+        for (auto elem : message_buffer.headers()) {
+            headers += fmt::format("{}: {}\n", elem.first, elem.second);
+        }
+        write_log(appstate, "Headers:\n{}Body: \n{}\n\nRaw: \n{}\n\n",
+                headers, body.dump(4), message_buffer.raw());
+    }
+}
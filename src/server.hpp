@@ -0,0 +1,184 @@
+#pragma once
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+#include <nlohmann/json.hpp>
+
+#include <glslang/Public/ShaderLang.h>
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "analysiscache.hpp"
+#include "builtins.hpp"
+#include "cancellation.hpp"
+#include "diagnosticsworker.hpp"
+#include "document.hpp"
+#include "includecache.hpp"
+#include "messagebuffer.hpp"
+#include "recording.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "symbolindex.hpp"
+#include "symbols.hpp"
+#include "threadpool.hpp"
+#include "workspace.hpp"
+
+using json = nlohmann::json;
+
+/// By default we target the most recent graphics APIs to be maximally permissive.
+struct TargetVersions {
+    // The target API (eg, Vulkan, OpenGL).
+    glslang::EShClient client_api = glslang::EShClientVulkan;
+    glslang::EShTargetClientVersion client_api_version = glslang::EShTargetVulkan_1_3;
+
+    // The target SPIR-V version
+    glslang::EShTargetLanguageVersion spv_version = glslang::EShTargetSpv_1_6;
+
+    // Options for glslValidator
+    EShMessages options = EShMessages(0);
+};
+
+/// Creates the latency histograms of the methods the server handles, by
+/// method name. Other methods share the histogram of `(other)`.
+std::map<std::string, LatencyHistogram*, std::less<>> make_method_histograms(Stats& stats);
+
+/// The latency histograms of the stages that requests go through.
+struct StageHistograms {
+    /// Time spent waiting in the scheduler before a handler starts.
+    LatencyHistogram& queue;
+    LatencyHistogram& diagnostics;
+    LatencyHistogram& parse;
+    LatencyHistogram& parsed_symbols;
+    LatencyHistogram& extract_symbols;
+    /// Time spent turning a response into text.
+    LatencyHistogram& serialize;
+};
+
+/// Creates the stage histograms, named `stage:<stage>`.
+StageHistograms make_stage_histograms(Stats& stats);
+
+struct AppState {
+    Workspace workspace;
+    IncludeCache include_cache;
+    bool verbose;
+    bool use_logfile;
+    std::ofstream logfile_stream;
+    std::mutex logfile_mutex;
+    TargetVersions target;
+    /// Latency histograms of the handled methods and their stages.
+    Stats stats;
+    /// The histograms in `stats` of each handled method, looked up once
+    /// rather than for every message. Never changes, so it needs no lock.
+    const std::map<std::string, LatencyHistogram*, std::less<>> method_histograms = make_method_histograms(stats);
+    /// The histograms in `stats` of each stage, looked up once as well.
+    const StageHistograms stage_histograms = make_stage_histograms(stats);
+    /// The results of recent parses, by text and environment.
+    AnalysisCache analysis_cache;
+
+    /// Where messages to the client are written: stdout, or a copy of it
+    /// after `isolate_output`.
+    int output_fd = 1;
+    /// Serializes writes of whole messages to the output.
+    std::mutex output_mutex;
+    /// Drops all messages to the client instead of writing them, when there is
+    /// no client (eg. while replaying a recorded session).
+    bool discard_output = false;
+    /// If set, every message received from the client is recorded.
+    std::unique_ptr<SessionRecorder> recorder;
+    /// If set, diagnostics are computed in the background and published
+    /// asynchronously. Otherwise they are returned with the triggering message.
+    std::unique_ptr<DiagnosticsWorker> diagnostics_worker;
+
+    /// The maximum number of items in a completion reply.
+    size_t max_completions;
+    /// Indent responses for readability, at the cost of larger messages.
+    bool pretty_print;
+
+    /// The uris of the workspace folders given by the client.
+    std::vector<std::string> workspace_roots;
+    /// Whether the client accepts `$/progress` notifications.
+    bool client_supports_progress = false;
+
+    /// Where persistent data like the symbol index is stored. Empty if
+    /// nothing should be stored.
+    std::string cache_dir;
+    /// The symbols of the files in the workspace, if there is a workspace.
+    std::unique_ptr<SymbolIndex> symbol_index;
+    /// If set, read-only requests run on its threads, and all responses are
+    /// sent through it, in the order of the requests unless an interactive
+    /// one overtakes a background one.
+    std::unique_ptr<RequestScheduler> scheduler;
+    /// Runs the initial indexing of the workspace, if that happens in the
+    /// background. Declared last so that it is stopped before the index goes away.
+    std::unique_ptr<ThreadPool> index_pool;
+};
+
+/// Writes to the log file, if there is one. May be called from any thread.
+template <typename... Args>
+void write_log(AppState& appstate, fmt::format_string<Args...> format, Args&&... args)
+{
+    if (!appstate.use_logfile) return;
+    std::lock_guard<std::mutex> lock{appstate.logfile_mutex};
+    fmt::print(appstate.logfile_stream, format, std::forward<Args>(args)...);
+    appstate.logfile_stream.flush();
+}
+
+/// Writes a complete message to the client. May be called from any thread.
+void send_message(AppState& appstate, std::string_view message);
+
+/// Sends the messages to the client through a private copy of stdout, and
+/// points stdout itself at /dev/null, so that output printed by libraries
+/// like glslang can not end up in the message stream. Must be called before
+/// other threads start. Returns false, changing nothing, if that fails.
+bool isolate_output(AppState& appstate);
+
+/// Serializes and sends a response or notification to the client. May be
+/// called from any thread; each thread reuses its own output buffer.
+void send_response(AppState& appstate, json response);
+
+/// Returns the shader stage for a file name, based on its extension. Throws
+/// `std::invalid_argument` for unknown extensions.
+EShLanguage find_language(const std::string& name);
+
+/// Parses a document with glslang and returns its diagnostics. The symbols
+/// found by the parse are recorded on the document. Throws `RequestCancelled`
+/// if `token` is cancelled before the work is done.
+json get_diagnostics(const std::string& uri, const Document& content, AppState& appstate,
+        const CancellationToken& token = {});
+
+/// Returns the open document with the given uri, or else the file on disk.
+std::optional<Document> get_file_document(const std::string& uri, const WorkspaceSnapshot& workspace,
+        AppState& appstate);
+
+/// Returns the builtin symbols for the stage of the given document.
+std::shared_ptr<const BuiltinSymbols> get_builtin_symbols(const std::string& uri, AppState& appstate);
+
+/// Returns the symbols visible from the given document.
+SymbolSet get_symbols(const std::string& uri, const WorkspaceSnapshot& workspace, AppState& appstate);
+
+json make_diagnostics_notification(const std::string& uri, int version, json diagnostics);
+
+/// Returns the default directory for persistent data, following the XDG base
+/// directory specification. Empty if there is no home directory.
+std::string default_cache_dir();
+
+/// Handles a complete message from the client, returning the response to
+/// send, if any. A request that can not be handled, eg. because of missing
+/// parameters, is answered with an error instead of throwing.
+std::optional<json> handle_message(const MessageBuffer& message_buffer, AppState& appstate);
+
+/// Handles a complete message from the client and sends the response, if
+/// any. With a scheduler, read-only requests are handed to it and run later
+/// against the workspace as it is now, and `$/cancelRequest` cancels them.
+void schedule_message(const MessageBuffer& message_buffer, AppState& appstate);
+
+void log_received_message(const MessageBuffer& message_buffer, AppState& appstate);
@@ -0,0 +1,101 @@
+#include "stats.hpp"
+
+#include <fmt/format.h>
+
+#include <bit>
+
+int LatencyHistogram::bucket_index(uint64_t value)
+{
+    // Values below one sub-bucket range are exact; above that, the exponent
+    // selects the power of two and the next bits the linear sub-bucket.
+    if (value < SUB_BUCKETS) return static_cast<int>(value);
+    int exponent = std::bit_width(value) - SUB_BUCKET_BITS - 1;
+    int sub_bucket = static_cast<int>(value >> exponent) - SUB_BUCKETS;
+    int index = (exponent + 1) * SUB_BUCKETS + sub_bucket;
+    return std::min(index, BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(int index)
+{
+    if (index < SUB_BUCKETS) return index;
+    int exponent = index / SUB_BUCKETS - 1;
+    uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub_bucket + 1) << exponent) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration)
+{
+    uint64_t value = duration.count() > 0 ? duration.count() : 0;
+    m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double fraction) const
+{
+    uint64_t count = this->count();
+    if (count == 0) return std::chrono::nanoseconds(0);
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+            return std::chrono::nanoseconds(std::min(bucket_upper_bound(i), max));
+        }
+    }
+    return std::chrono::nanoseconds(m_max.load(std::memory_order_relaxed));
+}
+
+json LatencyHistogram::to_json() const
+{
+    auto milliseconds = [](double nanoseconds) { return nanoseconds / 1e6; };
+    uint64_t count = this->count();
+    return json{
+        { "count", count },
+        { "mean_ms", count ? milliseconds(double(m_sum.load(std::memory_order_relaxed)) / count) : 0.0 },
+        { "p50_ms", milliseconds(percentile(0.5).count()) },
+        { "p90_ms", milliseconds(percentile(0.9).count()) },
+        { "p99_ms", milliseconds(percentile(0.99).count()) },
+        { "max_ms", milliseconds(m_max.load(std::memory_order_relaxed)) },
+    };
+}
+
+LatencyHistogram& Stats::histogram(std::string_view name)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_histograms.find(name);
+    if (it == m_histograms.end()) {
+        it = m_histograms.emplace(std::string(name), std::make_unique<LatencyHistogram>()).first;
+    }
+    return *it->second;
+}
+
+json Stats::to_json()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    json result = json::object();
+    for (const auto& [name, histogram] : m_histograms) {
+        if (histogram->count() == 0) continue;
+        result[name] = histogram->to_json();
+    }
+    return result;
+}
+
+std::string Stats::to_string()
+{
+    json stats = to_json();
+    std::string result = fmt::format("{:<44} {:>8} {:>9} {:>9} {:>9} {:>9}\n",
+            "histogram", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (const auto& [name, histogram] : stats.items()) {
+        result += fmt::format("{:<44} {:>8} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n", name,
+                histogram["count"].get<uint64_t>(), histogram["p50_ms"].get<double>(),
+                histogram["p90_ms"].get<double>(), histogram["p99_ms"].get<double>(),
+                histogram["max_ms"].get<double>());
+    }
+    return result;
+}
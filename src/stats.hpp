@@ -0,0 +1,83 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+using json = nlohmann::json;
+
+/// A histogram of durations with bounded relative error, in the style of
+/// HdrHistogram: every power of two is split into a fixed number of linear
+/// sub-buckets, so each recorded value is off by at most 1/16th. Recording
+/// is a handful of relaxed atomic increments and may happen from any thread.
+class LatencyHistogram {
+public:
+    void record(std::chrono::nanoseconds duration);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    /// Returns the duration below which the given fraction of the recorded
+    /// values lie, within the precision of the buckets.
+    std::chrono::nanoseconds percentile(double fraction) const;
+
+    /// Returns the count, mean, p50, p90, p99 and maximum, in milliseconds.
+    json to_json() const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    /// Enough powers of two to cover durations of well over an hour.
+    static constexpr int EXPONENTS = 44;
+    static constexpr int BUCKETS = EXPONENTS * SUB_BUCKETS;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(int index);
+
+    std::array<std::atomic<uint64_t>, BUCKETS> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+/// Latency histograms by name, for the handled methods (`method:<name>`)
+/// and the stages of the work they do (`stage:<name>`).
+class Stats {
+public:
+    /// Returns the histogram with the given name, creating it on first use.
+    /// The reference stays valid for the lifetime of the `Stats`.
+    LatencyHistogram& histogram(std::string_view name);
+
+    /// Returns the summary of each histogram. Histograms that have not
+    /// recorded anything yet are left out.
+    json to_json();
+
+    /// Returns a table of all histograms, for humans.
+    std::string to_string();
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>, std::less<>> m_histograms;
+};
+
+/// Records the time from its construction to its destruction.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram)
+        : m_histogram(histogram), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { m_histogram.record(std::chrono::steady_clock::now() - m_start); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,19 @@
+#include "stringtable.hpp"
+
+uint32_t StringTable::intern(std::string_view string)
+{
+    auto it = m_ids.find(string);
+    if (it != m_ids.end()) return it->second;
+
+    uint32_t id = m_strings.size();
+    const std::string& stored = m_strings.emplace_back(string);
+    m_ids.emplace(stored, id);
+    return id;
+}
+
+std::optional<uint32_t> StringTable::find(std::string_view string) const
+{
+    auto it = m_ids.find(string);
+    if (it == m_ids.end()) return std::nullopt;
+    return it->second;
+}
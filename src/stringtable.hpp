@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// Interns strings, so that each distinct string is stored once and can be
+/// referred to by a small integer id. Ids are dense, starting at zero, and
+/// views returned by `get` stay valid for the lifetime of the table.
+class StringTable {
+public:
+    /// Returns the id of `string`, adding it if it is new.
+    uint32_t intern(std::string_view string);
+
+    /// Returns the id of `string`, or `std::nullopt` if it was never interned.
+    std::optional<uint32_t> find(std::string_view string) const;
+
+    std::string_view get(uint32_t id) const { return m_strings[id]; }
+
+    size_t size() const { return m_strings.size(); }
+
+private:
+    /// A deque never moves its elements, so the views in `m_ids` stay valid.
+    std::deque<std::string> m_strings;
+    std::unordered_map<std::string_view, uint32_t> m_ids;
+};
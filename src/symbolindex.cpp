@@ -0,0 +1,510 @@
+#include "symbolindex.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "lineindex.hpp"
+#include "utils.hpp"
+
+namespace fs = std::filesystem;
+
+// On-disk layout, in native byte order:
+//
+//     IndexHeader
+//     FileRecord[file_count]        sorted by uri
+//     SymbolRecord[symbol_count]    sorted by name
+//     char strings[strings_size]
+//
+// All offsets in the records are relative to the start of the strings. The
+// checksum covers everything after the header.
+//
+// Mapping only checks the header and the total size, so that a large index
+// is usable right away. The checksum, the records and their order are checked
+// by `verify`, before the records are indexed by name or copied into a new
+// index. Until then, records are bounds-checked as they are read: a string
+// outside of the strings reads as empty, and so does the uri of a symbol that
+// refers to a file that does not exist.
+
+static const char INDEX_MAGIC[8] = { 'G', 'L', 'S', 'L', 'L', 'S', 'I', 'X' };
+static const uint32_t INDEX_VERSION = 4;
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t symbol_count;
+    uint32_t strings_size;
+    uint64_t checksum;
+};
+
+struct FileRecord {
+    uint64_t content_hash;
+    uint32_t uri_offset;
+    uint32_t uri_length;
+};
+
+struct SymbolRecord {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t details_offset;
+    uint32_t details_length;
+    uint32_t file;
+    int32_t offset;
+    int32_t line;
+    int32_t character;
+    uint32_t kind;
+};
+
+/// Typed access to a mapped index whose header has passed validation.
+struct IndexView {
+    const IndexHeader* header;
+    const FileRecord* files;
+    const SymbolRecord* symbols;
+    const char* strings;
+
+    explicit IndexView(const char* data)
+        : header(reinterpret_cast<const IndexHeader*>(data))
+        , files(reinterpret_cast<const FileRecord*>(data + sizeof(IndexHeader)))
+        , symbols(reinterpret_cast<const SymbolRecord*>(files + header->file_count))
+        , strings(reinterpret_cast<const char*>(symbols + header->symbol_count))
+    {}
+
+    std::string_view string(uint32_t offset, uint32_t length) const {
+        if (uint64_t(offset) + length > header->strings_size) return {};
+        return std::string_view(strings + offset, length);
+    }
+    std::string_view uri(const FileRecord& file) const {
+        return string(file.uri_offset, file.uri_length);
+    }
+    /// The uri of the file defining a symbol.
+    std::string_view uri(const SymbolRecord& symbol) const {
+        if (symbol.file >= header->file_count) return {};
+        return uri(files[symbol.file]);
+    }
+    std::string_view name(const SymbolRecord& symbol) const {
+        return string(symbol.name_offset, symbol.name_length);
+    }
+};
+
+static bool is_valid_index(const char* data, size_t size)
+{
+    if (size < sizeof(IndexHeader)) return false;
+    const auto* header = reinterpret_cast<const IndexHeader*>(data);
+    if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) return false;
+    if (header->version != INDEX_VERSION) return false;
+
+    uint64_t expected_size = sizeof(IndexHeader)
+        + uint64_t(header->file_count) * sizeof(FileRecord)
+        + uint64_t(header->symbol_count) * sizeof(SymbolRecord)
+        + header->strings_size;
+    return expected_size == size;
+}
+
+/// Whether a mapped index with a valid header is intact: it matches its
+/// checksum, no record points outside of the file, and the records are in
+/// the order lookups rely on.
+static bool is_intact_index(const char* data, size_t size)
+{
+    IndexView view(data);
+    std::string_view payload(data + sizeof(IndexHeader), size - sizeof(IndexHeader));
+    if (hash_bytes(payload) != view.header->checksum) return false;
+
+    // The checksum only catches accidental damage.
+    auto in_strings = [&](uint32_t offset, uint32_t length) {
+        return uint64_t(offset) + length <= view.header->strings_size;
+    };
+    for (uint32_t i = 0; i < view.header->file_count; i++) {
+        const FileRecord& file = view.files[i];
+        if (!in_strings(file.uri_offset, file.uri_length)) return false;
+        if (i > 0 && !(view.uri(view.files[i - 1]) < view.uri(file))) return false;
+    }
+    for (uint32_t i = 0; i < view.header->symbol_count; i++) {
+        const SymbolRecord& symbol = view.symbols[i];
+        if (!in_strings(symbol.name_offset, symbol.name_length)) return false;
+        if (!in_strings(symbol.details_offset, symbol.details_length)) return false;
+        if (symbol.file >= view.header->file_count) return false;
+        if (i > 0 && view.name(symbol) < view.name(view.symbols[i - 1])) return false;
+    }
+    return true;
+}
+
+/// Whether the file a uri refers to still exists. Uris of other schemes are
+/// assumed to.
+static bool file_exists(std::string_view uri)
+{
+    std::string uri_string(uri);
+    const char* path = strip_prefix("file://", uri_string.c_str());
+    if (!path) return true;
+    std::error_code error;
+    return fs::exists(path, error) || error;
+}
+
+SymbolIndex::SymbolIndex(fs::path path)
+    : m_path(std::move(path))
+{
+    map_file();
+}
+
+SymbolIndex::~SymbolIndex()
+{
+    unmap_file();
+}
+
+bool SymbolIndex::map_file()
+{
+    if (!is_persistent()) return false;
+
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+
+    if (!is_valid_index(static_cast<const char*>(data), info.st_size)) {
+        // Start over with an empty index, which replaces the file on save.
+        ::munmap(data, info.st_size);
+        return false;
+    }
+
+    m_data = static_cast<const char*>(data);
+    m_size = info.st_size;
+    return true;
+}
+
+void SymbolIndex::unmap_file()
+{
+    if (m_data) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+bool SymbolIndex::is_persistent() const
+{
+    return !m_path.empty();
+}
+
+int64_t SymbolIndex::find_mapped_file(std::string_view uri) const
+{
+    if (!m_data) return -1;
+    IndexView view(m_data);
+    auto end = view.files + view.header->file_count;
+    auto it = std::lower_bound(view.files, end, uri, [&](const FileRecord& file, std::string_view uri) {
+        return view.uri(file) < uri;
+    });
+    if (it == end || view.uri(*it) != uri) return -1;
+    return it - view.files;
+}
+
+uint64_t SymbolIndex::mapped_content_hash(std::string_view uri) const
+{
+    int64_t file = find_mapped_file(uri);
+    if (file < 0) return 0;
+    return IndexView(m_data).files[file].content_hash;
+}
+
+bool SymbolIndex::update(const std::string& uri, std::string_view text)
+{
+    uint64_t content_hash = hash_bytes(text);
+    auto is_indexed = [&] {
+        auto updated = m_updated.find(uri);
+        if (updated != m_updated.end()) return updated->second.content_hash == content_hash;
+        return mapped_content_hash(uri) == content_hash;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (is_indexed()) return false;
+    }
+
+    // Scan without holding the lock, so that files can be indexed in parallel.
+    SymbolTable symbols;
+    std::string text_string(text);
+    extract_symbols(text_string.c_str(), symbols);
+
+    LineIndex line_index(text);
+    FileSymbols file{content_hash, {}};
+    file.symbols.reserve(symbols.size());
+    for (const auto* entry : symbols.sorted()) {
+        int offset = entry->symbol.location.offset;
+        file.symbols.push_back({ std::string(entry->name), entry->symbol.kind, std::string(entry->symbol.details),
+                offset, line_index.position(offset) });
+    }
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (is_indexed()) return false;
+
+    if (m_names_loaded) {
+        m_names.remove_file(uri);
+        for (const auto& symbol : file.symbols) {
+            m_names.add(uri, symbol.name, symbol.kind, symbol.details, symbol.offset, symbol.position);
+        }
+    }
+    m_updated.insert_or_assign(uri, std::move(file));
+    return true;
+}
+
+std::vector<IndexedSymbol> SymbolIndex::find(std::string_view name)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    std::vector<IndexedSymbol> results;
+
+    for (const auto& [uri, file] : m_updated) {
+        auto it = std::lower_bound(file.symbols.begin(), file.symbols.end(), name,
+                [](const FileSymbol& symbol, std::string_view name) { return symbol.name < name; });
+        if (it != file.symbols.end() && it->name == name) {
+            results.push_back({ uri, it->name, it->kind, it->details, it->offset, it->position });
+        }
+    }
+
+    if (m_data) {
+        IndexView view(m_data);
+        auto end = view.symbols + view.header->symbol_count;
+        auto it = std::lower_bound(view.symbols, end, name, [&](const SymbolRecord& symbol, std::string_view name) {
+            return view.name(symbol) < name;
+        });
+        for (; it != end && view.name(*it) == name; ++it) {
+            std::string_view uri = view.uri(*it);
+            if (uri.empty() || m_updated.find(uri) != m_updated.end()) continue; // damaged or superseded
+            results.push_back({
+                std::string(uri),
+                std::string(name),
+                static_cast<Symbol::Kind>(it->kind),
+                std::string(view.string(it->details_offset, it->details_length)),
+                it->offset,
+                SourceFileLocation{ it->line, it->character },
+            });
+        }
+    }
+
+    return results;
+}
+
+bool SymbolIndex::verify()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return verify_mapping();
+}
+
+bool SymbolIndex::verify_mapping()
+{
+    if (m_verified || !m_data) return true;
+    m_verified = true;
+    if (is_intact_index(m_data, m_size)) return true;
+
+    // Without the mapped entries, every file is indexed again, and the next
+    // save writes a new index.
+    unmap_file();
+    if (is_persistent()) {
+        std::error_code error;
+        fs::remove(m_path, error);
+    }
+    return false;
+}
+
+std::vector<IndexedSymbol> SymbolIndex::search(std::string_view query, size_t limit)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (!m_names_loaded) load_names();
+    return m_names.search(query, limit);
+}
+
+void SymbolIndex::load_names()
+{
+    verify_mapping();
+    if (m_data) {
+        IndexView view(m_data);
+        for (uint32_t i = 0; i < view.header->symbol_count; i++) {
+            const SymbolRecord& symbol = view.symbols[i];
+            std::string_view uri = view.uri(symbol);
+            if (uri.empty() || m_updated.find(uri) != m_updated.end()) continue; // damaged or superseded
+            m_names.add(uri, view.name(symbol), static_cast<Symbol::Kind>(symbol.kind),
+                    view.string(symbol.details_offset, symbol.details_length), symbol.offset,
+                    SourceFileLocation{ symbol.line, symbol.character });
+        }
+    }
+    for (const auto& [uri, file] : m_updated) {
+        for (const auto& symbol : file.symbols) {
+            m_names.add(uri, symbol.name, symbol.kind, symbol.details, symbol.offset, symbol.position);
+        }
+    }
+    m_names_loaded = true;
+}
+
+size_t SymbolIndex::file_count()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    size_t count = m_updated.size();
+    if (m_data) {
+        IndexView view(m_data);
+        for (uint32_t i = 0; i < view.header->file_count; i++) {
+            if (m_updated.find(view.uri(view.files[i])) == m_updated.end()) count++;
+        }
+    }
+    return count;
+}
+
+bool SymbolIndex::save()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (!is_persistent()) return true;
+    // Damaged records must not be carried over into the new index.
+    verify_mapping();
+
+    // Merge the mapped entries with the updated ones, which take precedence.
+    struct PendingSymbol {
+        std::string_view name;
+        std::string_view details;
+        uint32_t file;
+        int32_t offset;
+        SourceFileLocation position;
+        uint32_t kind;
+    };
+    std::vector<std::pair<std::string_view, uint64_t>> files;
+    std::vector<PendingSymbol> symbols;
+
+    // Files that were deleted since they were indexed are dropped.
+    std::map<std::string_view, uint64_t> all_files;
+    std::vector<std::string> removed_files;
+    for (const auto& [uri, file] : m_updated) {
+        if (file_exists(uri)) {
+            all_files.emplace(uri, file.content_hash);
+        } else {
+            removed_files.push_back(uri);
+        }
+    }
+    if (m_data) {
+        IndexView view(m_data);
+        for (uint32_t i = 0; i < view.header->file_count; i++) {
+            std::string_view uri = view.uri(view.files[i]);
+            if (uri.empty() || all_files.contains(uri) || m_updated.find(uri) != m_updated.end()) continue;
+            if (file_exists(uri)) {
+                all_files.emplace(uri, view.files[i].content_hash);
+            } else {
+                removed_files.emplace_back(uri);
+            }
+        }
+    }
+    if (m_updated.empty() && removed_files.empty()) return true;
+
+    std::map<std::string_view, uint32_t> file_ids;
+    for (const auto& [uri, content_hash] : all_files) {
+        file_ids.emplace(uri, files.size());
+        files.emplace_back(uri, content_hash);
+    }
+
+    for (const auto& [uri, file] : m_updated) {
+        auto file_id_entry = file_ids.find(uri);
+        if (file_id_entry == file_ids.end()) continue;
+        uint32_t file_id = file_id_entry->second;
+        for (const auto& symbol : file.symbols) {
+            symbols.push_back({ symbol.name, symbol.details, file_id, symbol.offset, symbol.position,
+                    uint32_t(symbol.kind) });
+        }
+    }
+    if (m_data) {
+        IndexView view(m_data);
+        for (uint32_t i = 0; i < view.header->symbol_count; i++) {
+            const SymbolRecord& symbol = view.symbols[i];
+            auto file_id = file_ids.find(view.uri(symbol));
+            if (file_id == file_ids.end() || m_updated.find(file_id->first) != m_updated.end()) continue;
+            symbols.push_back({
+                view.name(symbol),
+                view.string(symbol.details_offset, symbol.details_length),
+                file_id->second,
+                symbol.offset,
+                SourceFileLocation{ symbol.line, symbol.character },
+                symbol.kind,
+            });
+        }
+    }
+    std::stable_sort(symbols.begin(), symbols.end(), [](const PendingSymbol& a, const PendingSymbol& b) {
+        return a.name < b.name;
+    });
+
+    // Serialize the records and strings.
+    std::string strings;
+    auto add_string = [&](std::string_view string) {
+        uint32_t offset = strings.size();
+        strings += string;
+        return offset;
+    };
+
+    std::vector<FileRecord> file_records;
+    file_records.reserve(files.size());
+    for (const auto& [uri, content_hash] : files) {
+        file_records.push_back({ content_hash, add_string(uri), uint32_t(uri.size()) });
+    }
+
+    std::vector<SymbolRecord> symbol_records;
+    symbol_records.reserve(symbols.size());
+    for (const auto& symbol : symbols) {
+        symbol_records.push_back({
+            add_string(symbol.name), uint32_t(symbol.name.size()),
+            add_string(symbol.details), uint32_t(symbol.details.size()),
+            symbol.file, symbol.offset, symbol.position.line, symbol.position.character, symbol.kind,
+        });
+    }
+
+    std::string payload;
+    payload.append(reinterpret_cast<const char*>(file_records.data()), file_records.size() * sizeof(FileRecord));
+    payload.append(reinterpret_cast<const char*>(symbol_records.data()), symbol_records.size() * sizeof(SymbolRecord));
+    payload += strings;
+
+    IndexHeader header{};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.file_count = file_records.size();
+    header.symbol_count = symbol_records.size();
+    header.strings_size = strings.size();
+    header.checksum = hash_bytes(payload);
+
+    // Write a new file and rename it over the old one, so that readers never
+    // see a partially written index.
+    std::error_code error;
+    fs::create_directories(m_path.parent_path(), error);
+    fs::path temp_path = m_path;
+    temp_path += ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream output{temp_path, std::ios::binary | std::ios::trunc};
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(payload.data(), payload.size());
+        if (!output) {
+            fs::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    // The strings in `files` and `symbols` may point into the mapping, so
+    // only unmap once everything has been written.
+    unmap_file();
+    fs::rename(temp_path, m_path, error);
+    if (error) {
+        fs::remove(temp_path, error);
+        map_file();
+        return false;
+    }
+
+    m_updated.clear();
+    for (const auto& uri : removed_files) {
+        m_names.remove_file(uri);
+    }
+    map_file();
+    m_verified = true;
+    return true;
+}
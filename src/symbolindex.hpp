@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nameindex.hpp"
+#include "symbols.hpp"
+#include "utils.hpp"
+
+/// A symbol as stored in the workspace index.
+struct IndexedSymbol {
+    std::string uri;
+    std::string name;
+    Symbol::Kind kind;
+    std::string details;
+    /// Byte offset of the definition in the file.
+    int offset;
+    /// The same location as a position, as of when the file was indexed.
+    SourceFileLocation position;
+};
+
+/// A persistent index of the symbols defined in each file of a workspace.
+///
+/// The index lives in a single binary file that is memory-mapped on startup,
+/// so lookups can be answered before any file has been scanned. Each file's
+/// entry is keyed by a hash of its contents and is only rebuilt when that
+/// hash changes. Updates are kept in memory until `save` writes a new index
+/// file and atomically replaces the old one, leaving out files that no
+/// longer exist. An index with a damaged header or written by another
+/// version is discarded and rebuilt from scratch. So is an index that fails
+/// `verify`, which reads the whole file and is meant to run in the background
+/// before the workspace is indexed; it also runs before the records are
+/// indexed by name or saved again. An index with an empty path is kept in
+/// memory only.
+///
+/// All methods may be called from any thread.
+class SymbolIndex {
+public:
+    explicit SymbolIndex(std::filesystem::path path);
+    ~SymbolIndex();
+
+    SymbolIndex(const SymbolIndex&) = delete;
+    SymbolIndex& operator=(const SymbolIndex&) = delete;
+
+    /// Updates the entry for a file with its current contents. Returns `true`
+    /// if the contents differed from the indexed ones.
+    bool update(const std::string& uri, std::string_view text);
+
+    /// Returns the definitions of `name` across all indexed files.
+    std::vector<IndexedSymbol> find(std::string_view name);
+
+    /// Checks the mapped index against its checksum, unless that was done
+    /// already, and discards it if it is damaged, so that every file is
+    /// indexed again. Returns `false` if the index was discarded.
+    bool verify();
+
+    /// Returns up to `limit` symbols matching a fuzzy query, best matches first.
+    std::vector<IndexedSymbol> search(std::string_view query, size_t limit);
+
+    /// Writes pending updates to disk, and drops the files that were deleted.
+    /// Rewrites the whole index, so it is meant for the end of indexing and
+    /// for shutdown. Returns `false` on failure, in which case the updates are
+    /// kept for the next attempt.
+    bool save();
+
+    /// The number of files in the index.
+    size_t file_count();
+
+private:
+    struct FileSymbol {
+        std::string name;
+        Symbol::Kind kind;
+        std::string details;
+        int offset;
+        SourceFileLocation position;
+    };
+    struct FileSymbols {
+        uint64_t content_hash;
+        /// Sorted by name.
+        std::vector<FileSymbol> symbols;
+    };
+
+    bool is_persistent() const;
+    bool map_file();
+    void unmap_file();
+    /// Looks up a file in the mapped index. Returns its record index, or -1.
+    int64_t find_mapped_file(std::string_view uri) const;
+    uint64_t mapped_content_hash(std::string_view uri) const;
+    /// Fills `m_names` with the mapped and updated symbols. Must be called
+    /// with the mutex held.
+    void load_names();
+    /// Implements `verify`. Must be called with the mutex held.
+    bool verify_mapping();
+
+    std::filesystem::path m_path;
+    std::mutex m_mutex;
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    /// Whether the mapped index has been checked by `verify_mapping`.
+    bool m_verified = false;
+
+    /// Files changed since the index was mapped. These take precedence over
+    /// the mapped entries for the same uri.
+    std::map<std::string, FileSymbols, std::less<>> m_updated;
+
+    /// All symbols, both mapped and updated, for fuzzy searches. Only built
+    /// on the first search, since many sessions never search the workspace.
+    NameIndex m_names;
+    bool m_names_loaded = false;
+};
@@ -1,9 +1,105 @@
 #include "symbols.hpp"
+#include "scan.hpp"
+#include "stringtable.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory_resource>
+#include <mutex>
 #include <vector>
 
-void add_builtin_types(SymbolMap& symbols)  {
+static std::mutex uri_mutex;
+static StringTable uri_table;
+
+uint32_t intern_uri(std::string_view uri) {
+    std::lock_guard<std::mutex> lock{uri_mutex};
+    return uri_table.intern(uri);
+}
+
+std::string_view get_uri(uint32_t id) {
+    std::lock_guard<std::mutex> lock{uri_mutex};
+    return uri_table.get(id);
+}
+
+std::string_view StringArena::store(std::string_view string) {
+    if (string.empty()) return {};
+    if (!m_resource) m_resource = std::make_unique<std::pmr::monotonic_buffer_resource>(INITIAL_SIZE);
+
+    m_size += string.size();
+    char* stored = static_cast<char*>(m_resource->allocate(string.size(), 1));
+    std::memcpy(stored, string.data(), string.size());
+    return std::string_view(stored, string.size());
+}
+
+void SymbolTable::reserve(size_t count) {
+    m_entries.reserve(count);
+    size_t capacity = 16;
+    while (capacity * 3 < count * 4) capacity *= 2;
+    if (capacity > m_slots.size()) rehash(capacity);
+}
+
+size_t SymbolTable::memory_usage() const {
+    return sizeof(*this) + m_entries.capacity() * sizeof(Entry) + m_slots.capacity() * sizeof(Slot) + m_arena.size();
+}
+
+size_t SymbolTable::find_slot(std::string_view name, uint32_t hash) const {
+    size_t mask = m_slots.size() - 1;
+    size_t index = hash & mask;
+    while (true) {
+        const Slot& slot = m_slots[index];
+        if (slot.entry == 0) return index;
+        if (slot.hash == hash && m_entries[slot.entry - 1].name == name) return index;
+        index = (index + 1) & mask;
+    }
+}
+
+void SymbolTable::rehash(size_t capacity) {
+    std::vector<Slot> slots(capacity, Slot{0, 0});
+    size_t mask = capacity - 1;
+    for (const Slot& slot : m_slots) {
+        if (slot.entry == 0) continue;
+        size_t index = slot.hash & mask;
+        while (slots[index].entry != 0) index = (index + 1) & mask;
+        slots[index] = slot;
+    }
+    m_slots = std::move(slots);
+}
+
+bool SymbolTable::emplace(std::string_view name, const Symbol& symbol) {
+    // Keep the load factor below 3/4, so that probe sequences stay short.
+    if ((m_entries.size() + 1) * 4 > m_slots.size() * 3) {
+        rehash(std::max<size_t>(16, m_slots.size() * 2));
+    }
+
+    uint32_t hash = hash_bytes(name);
+    size_t index = find_slot(name, hash);
+    if (m_slots[index].entry != 0) return false;
+
+    Entry entry{ m_arena.store(name), symbol };
+    entry.symbol.details = m_arena.store(symbol.details);
+    m_entries.push_back(entry);
+    m_slots[index] = Slot{ hash, uint32_t(m_entries.size()) };
+    return true;
+}
+
+const Symbol* SymbolTable::find(std::string_view name) const {
+    if (m_entries.empty()) return nullptr;
+    const Slot& slot = m_slots[find_slot(name, hash_bytes(name))];
+    if (slot.entry == 0) return nullptr;
+    return &m_entries[slot.entry - 1].symbol;
+}
+
+std::vector<const SymbolTable::Entry*> SymbolTable::sorted() const {
+    std::vector<const Entry*> entries;
+    entries.reserve(m_entries.size());
+    for (const Entry& entry : m_entries) entries.push_back(&entry);
+    std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->name < b->name; });
+    return entries;
+}
+
+void add_builtin_types(SymbolTable& symbols)  {
     symbols.emplace("bool", Symbol{Symbol::Type, "<type>"});
     symbols.emplace("int", Symbol{Symbol::Type, "<type>"});
     symbols.emplace("uint", Symbol{Symbol::Type, "<type>"});
@@ -95,6 +191,11 @@ void add_builtin_types(SymbolMap& symbols)  {
     }
 }
 
+const Symbol* SymbolSet::find(std::string_view name) const {
+    if (auto builtin = builtins->find(name)) return builtin;
+    return locals->find(name);
+}
+
 struct Word {
     const char* start = nullptr;
     const char* end = nullptr;
@@ -113,28 +214,47 @@ bool is_whitespace(char c) {
     return c == ' ' || c == '\t' || c == '\n';
 }
 
-/// Extracts all global symbols from the given string, and inserts them into the symbol map.
+/// Extracts all global symbols from the given string, and inserts them into the symbol table.
 /// This will not register symbols within function bodies, as they are context dependent.
 ///
 /// The current implementation uses naive heuristics and thus may not handle
 /// certain cases that well, and also give wrong results. This should be
 /// replaced with an actual parser, but is workable for now.
-void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
-    std::vector<Word> words;
+void extract_symbols(const char* text, SymbolTable& symbols, uint32_t uri) {
+    // The words of the current declaration and the type being built are
+    // scratch data, reused across declarations. They rarely outgrow the stack
+    // buffer, so scanning makes no heap allocations of its own; only the
+    // symbol table does, in its arena.
+    std::array<std::byte, 4096> scratch_buffer;
+    std::pmr::monotonic_buffer_resource scratch{scratch_buffer.data(), scratch_buffer.size()};
+    std::pmr::vector<Word> words{&scratch};
+    std::pmr::string type{&scratch};
+    words.reserve(64);
+    type.reserve(256);
+
     int arguments = 0;
     Word array{};
     Word inside_block{};
 
+    const char* end = text + std::strlen(text);
+    TextScanner scanner(text, end);
+    // Returns the next `c` at or after `p`, or the end of the text.
+    auto skip_to = [end](const char* p, char c) {
+        const void* found = std::memchr(p, c, end - p);
+        return found ? static_cast<const char*>(found) : end;
+    };
+
+    // Bytes that are neither identifiers nor structure are skipped in blocks.
     const char* p = text;
-    while (*p) {
+    while (p < end && (p = scanner.find_symbol_token(p)) != end) {
         if (is_identifier_start_char(*p)) {
             const char* start = p;
-            while (is_identifier_char(*p)) p++;
+            p = scanner.skip_identifier(p);
             Word ident{start, p};
 
             if (*p == '[') {
                 const char* array_start = p;
-                while (*p && *p != ']') p++;
+                p = skip_to(p, ']');
                 array = Word{array_start, *p == ']' ? p+1 : p};
             }
 
@@ -142,7 +262,7 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
             if (ident.is_equal("layout")) {
                 while (is_whitespace(*p)) p++;
                 if (*p == '(') {
-                    while (*p && *p != ')') p++;
+                    p = skip_to(p, ')');
                 }
                 continue;
             }
@@ -153,8 +273,7 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
 
         // don't confuse numeric literals as identifiers
         if ('0' <= *p && *p <= '9') {
-            p++;
-            while (is_identifier_char(*p)) p++;
+            p = scanner.skip_identifier(p + 1);
             continue;
         } 
 
@@ -175,7 +294,7 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
             }
 
             // skip struct fields and function bodies (their contents are not global)
-            while (*p && *p != '}') p++;
+            p = skip_to(p, '}');
             continue;
         } 
 
@@ -221,13 +340,11 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
                 Word name_word = words[name_index];
                 Word type_word = type_index >= 0 ? words[type_index] : Word{};
 
-                std::string name(name_word.start, name_word.end);
-                std::string type(type_word.start, type_word.end);
+                std::string_view name(name_word.start, name_word.end - name_word.start);
+                type.assign(type_word.start, type_word.end);
 
                 if (!type.empty()) {
-                    if (symbols.find(type) == symbols.end()) {
-                        symbols.emplace(type, Symbol{Symbol::Type, "<type>"});
-                    }
+                    symbols.emplace(type, Symbol{Symbol::Type, "<type>"});
                 }
 
                 if (arguments == 0 && array.start) {
@@ -249,8 +366,9 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
                             type.push_back(' ');
                             while (t != arg.end && is_whitespace(*t)) t++;
                         } else {
-                            type.push_back(*t);
-                            t++;
+                            const char* run = t;
+                            while (t != arg.end && !is_whitespace(*t)) t++;
+                            type.append(run, t);
                         }
                     }
 
@@ -270,7 +388,7 @@ void extract_symbols(const char* text, SymbolMap& symbols, const char* uri) {
 
             if (*p == '=') {
                 // if we have a constant assignment, skip over the expression
-                while (*p && *p != ';') p++;
+                p = skip_to(p, ';');
             }
         }
 
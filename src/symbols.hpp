@@ -1,7 +1,20 @@
 #pragma once
 
-#include <string>
-#include <map>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+/// The id of a URI that was never interned; see `intern_uri`.
+constexpr uint32_t NO_URI = UINT32_MAX;
+
+/// Interns a document URI. The id, and the view returned by `get_uri`, stay
+/// valid for the lifetime of the process. Safe to call from any thread.
+uint32_t intern_uri(std::string_view uri);
+
+/// Returns the URI with the given id.
+std::string_view get_uri(uint32_t id);
 
 struct Symbol {
     enum Kind {
@@ -12,21 +25,126 @@ struct Symbol {
     };
 
     Kind kind = Unknown;
-    std::string details;
+    /// Points into the storage of the table holding the symbol.
+    std::string_view details;
 
     struct Location {
-        /// Name of the file the symbol is defined in. If `null` this is undefined.
-        const char* uri = nullptr;
-        /// If the uri is not `null`, the offset into the file where the symbol is defined.
+        /// Interned URI of the file the symbol is defined in, or `NO_URI` if this is undefined.
+        uint32_t uri = NO_URI;
+        /// If there is a uri, the offset into the file where the symbol is defined.
         int offset = -1;
+
+        bool has_uri() const { return uri != NO_URI; }
     } location;
 };
 
-typedef std::map<std::string, Symbol> SymbolMap;
+/// Bump-allocates strings from a monotonic buffer, so that storing many small
+/// strings costs a handful of allocations. Views stay valid until the arena
+/// is destroyed, including when it is moved.
+class StringArena {
+public:
+    /// Copies `string` into the arena.
+    std::string_view store(std::string_view string);
 
-/// Add the builtin types to the symbol map.
-void add_builtin_types(SymbolMap& symbols);
+    /// The number of bytes stored so far.
+    size_t size() const { return m_size; }
 
-/// Extracts symbols from the given file.
-void extract_symbols(const char* text, SymbolMap& symbols, const char* uri = nullptr);
+private:
+    static constexpr size_t INITIAL_SIZE = 16 * 1024;
+
+    /// Created on first use, so that empty tables do not allocate.
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> m_resource;
+    size_t m_size = 0;
+};
+
+/// Maps names to symbols. Names and details are copied into an arena owned by
+/// the table, and looked up through an open-addressing hash table over a
+/// contiguous array of entries, which are kept in insertion order.
+class SymbolTable {
+public:
+    struct Entry {
+        std::string_view name;
+        Symbol symbol;
+    };
+
+    SymbolTable() = default;
+    SymbolTable(SymbolTable&&) = default;
+    SymbolTable& operator=(SymbolTable&&) = default;
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    /// Adds a symbol, unless there already is one with the same name. Returns
+    /// `true` if the symbol was added.
+    bool emplace(std::string_view name, const Symbol& symbol);
+
+    /// Returns the symbol with the given name, or null if there is none.
+    const Symbol* find(std::string_view name) const;
+
+    bool contains(std::string_view name) const { return find(name) != nullptr; }
+
+    size_t size() const { return m_entries.size(); }
+
+    void reserve(size_t count);
 
+    /// Returns an estimate of the memory held by the table, in bytes.
+    size_t memory_usage() const;
+
+    std::vector<Entry>::const_iterator begin() const { return m_entries.begin(); }
+    std::vector<Entry>::const_iterator end() const { return m_entries.end(); }
+
+    /// Returns the entries ordered by name.
+    std::vector<const Entry*> sorted() const;
+
+private:
+    struct Slot {
+        uint32_t hash;
+        /// One more than the index of the entry, or zero if the slot is empty.
+        uint32_t entry;
+    };
+
+    /// Returns the slot holding `name`, or the empty slot where it belongs.
+    size_t find_slot(std::string_view name, uint32_t hash) const;
+    void rehash(size_t capacity);
+
+    std::vector<Entry> m_entries;
+    std::vector<Slot> m_slots;
+    StringArena m_arena;
+};
+
+/// The symbols visible from a document: the document's own symbols layered
+/// over a shared set of builtin symbols. Both may be shared with other
+/// callers, so they must not be modified. Builtins take precedence, matching
+/// the order in which the symbols used to be inserted into a single map.
+struct SymbolSet {
+    std::shared_ptr<const SymbolTable> builtins;
+    std::shared_ptr<const SymbolTable> locals;
+
+    /// Returns the symbol with the given name, or null if there is none.
+    const Symbol* find(std::string_view name) const;
+
+    /// Calls `f(name, symbol)` for every visible symbol, ordered by name.
+    template <typename F>
+    void for_each(F&& f) const {
+        auto sorted_builtins = builtins->sorted();
+        auto sorted_locals = locals->sorted();
+        auto builtin = sorted_builtins.begin();
+        auto local = sorted_locals.begin();
+        while (builtin != sorted_builtins.end() || local != sorted_locals.end()) {
+            if (local == sorted_locals.end()
+                    || (builtin != sorted_builtins.end() && (*builtin)->name <= (*local)->name)) {
+                if (local != sorted_locals.end() && (*local)->name == (*builtin)->name) ++local;
+                f((*builtin)->name, (*builtin)->symbol);
+                ++builtin;
+            } else {
+                f((*local)->name, (*local)->symbol);
+                ++local;
+            }
+        }
+    }
+};
+
+/// Add the builtin types to the symbol table.
+void add_builtin_types(SymbolTable& symbols);
+
+/// Extracts symbols from the given file.
+void extract_symbols(const char* text, SymbolTable& symbols, uint32_t uri = NO_URI);
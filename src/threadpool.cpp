@@ -0,0 +1,71 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Lowers the priority of the calling thread. On Linux the nice value is a
+/// per-thread attribute; elsewhere it would apply to the whole process, so
+/// the threads keep the default priority there.
+static void lower_thread_priority()
+{
+#ifdef __linux__
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop = true;
+        m_tasks.clear();
+    }
+    m_condition.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::run()
+{
+    lower_thread_priority();
+
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (true) {
+        m_condition.wait(lock, [&] { return m_stop || !m_tasks.empty(); });
+        if (m_stop) break;
+
+        Task task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of threads running background tasks in submission order.
+///
+/// The threads run at a lower scheduling priority where the platform allows
+/// it, so that they stay out of the way of the thread serving requests.
+/// Tasks that have not started when the pool is destroyed are dropped.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /// Starts `thread_count` threads, or one per core if it is zero.
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+
+    size_t thread_count() const { return m_threads.size(); }
+
+private:
+    void run();
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Task> m_tasks;
+    bool m_stop = false;
+
+    std::vector<std::thread> m_threads;
+};
@@ -36,42 +36,12 @@ std::string trim(const std::string& s, const std::string& delimiters = " \f\n\r\
     return trim_left(trim_right(s, delimiters), delimiters);
 }
 
-/// Returns the byte offset for the given character on the given line.
-// FIXME: use UTF-16 offsets
-// https://fasterthanli.me/articles/the-bottom-emoji-breaks-rust-analyzer
-int find_position_offset(const char* text, int line, int character) {
-    int offset = 0;
-    while (line > 0) {
-        while (text[offset] && text[offset] != '\n') offset += 1;
-        offset += text[offset] == '\n';
-        line -= 1;
-    }
-
-    while (character > 0 && text[offset] && text[offset] != '\n') {
-        offset += 1;
-        character -= 1;
-    }
-
-    return offset;
-}
-
-/// Given a byte offset into a file, returns the corresponding line and column.
-// FIXME: use UTF-16 offsets
-// https://fasterthanli.me/articles/the-bottom-emoji-breaks-rust-analyzer
-SourceFileLocation find_source_location(const char* text, int offset) {
-    SourceFileLocation location{ 0, 0 };
-    const char* p = text;
-    const char* end = text + offset;
-    while (*p && p < end) {
-        if (*p == '\n') {
-            location.line += 1;
-            location.character = 0;
-        } else {
-            location.character += 1;
-        }
-        p++;
-    }
-    return location;
+int utf8_sequence_length(char lead) {
+    unsigned char c = lead;
+    if (c >= 0xF0) return 4;
+    if (c >= 0xE0) return 3;
+    if (c >= 0xC0) return 2;
+    return 1;
 }
 
 /// Returns `true` if the character may start an identifier.
@@ -133,3 +103,12 @@ const char* strip_prefix(const char* prefix, const char* haystack) {
     }
     return haystack;
 }
+
+uint64_t hash_bytes(std::string_view bytes, uint64_t seed) {
+    uint64_t hash = seed;
+    for (char c : bytes) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 std::vector<std::string> split_string(const std::string& string_to_split, const std::string& pattern);
@@ -19,11 +21,9 @@ struct SourceFileLocation {
     int character;
 };
 
-/// Returns the byte offset for the given character on the given line.
-int find_position_offset(const char* text, int line, int character);
-
-/// Given a byte offset into a file, returns the corresponding line and column.
-SourceFileLocation find_source_location(const char* text, int offset);
+/// Returns the number of bytes in the UTF-8 sequence starting with `lead`.
+/// Stray continuation bytes count as a sequence of their own.
+int utf8_sequence_length(char lead);
 
 /// Returns `true` if the character may start an identifier.
 bool is_identifier_start_char(char c);
@@ -48,3 +48,7 @@ std::string make_path_uri(const std::string& path);
 /// If `haystack` does not begin with `prefix`, returns null.
 const char* strip_prefix(const char* prefix, const char* haystack);
 
+
+/// Returns a 64-bit FNV-1a hash of the given bytes. It is stable across runs,
+/// so it may be stored on disk.
+uint64_t hash_bytes(std::string_view bytes, uint64_t seed = 0xcbf29ce484222325);
@@ -1,6 +1,37 @@
 #include "workspace.hpp"
 
-Workspace::Workspace(){};
+std::optional<Document> WorkspaceSnapshot::get_document(const std::string& key) const
+{
+    auto it = m_documents.find(key);
+    if (it != m_documents.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+std::set<std::string> WorkspaceSnapshot::includes(const std::string& key) const
+{
+    auto it = m_includes.find(key);
+    if (it == m_includes.end()) return {};
+    return it->second;
+}
+
+std::vector<std::string> WorkspaceSnapshot::open_dependents(const std::string& key, size_t limit) const
+{
+    std::vector<std::string> dependents;
+    auto it = m_dependents.find(key);
+    if (it == m_dependents.end()) return dependents;
+
+    for (const auto& dependent : it->second) {
+        if (dependents.size() >= limit) break;
+        if (dependent != key && m_open_documents.contains(dependent)) {
+            dependents.push_back(dependent);
+        }
+    }
+    return dependents;
+}
+
+Workspace::Workspace() : m_state(std::make_shared<WorkspaceSnapshot>()) {};
 Workspace::~Workspace(){};
 
 bool Workspace::is_initialized()
@@ -13,32 +44,115 @@ void Workspace::set_initialized(bool new_value)
     m_initialized = new_value;
 };
 
-std::map<std::string, std::string>& Workspace::documents()
+std::shared_ptr<const WorkspaceSnapshot> Workspace::snapshot()
 {
-    return m_documents;
-};
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_state;
+}
+
+WorkspaceSnapshot& Workspace::mutable_state()
+{
+    // New snapshots are only handed out under the mutex, so a count of one
+    // means that nobody else can be reading the state.
+    if (m_state.use_count() > 1) {
+        m_state = std::make_shared<WorkspaceSnapshot>(*m_state);
+    }
+    return *m_state;
+}
+
+std::optional<Document> Workspace::get_document(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_state->get_document(key);
+}
+
+void Workspace::add_document(std::string key, std::string text, int version)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    mutable_state().m_documents[std::move(key)] = Document(std::move(text), version);
+}
 
-void Workspace::add_document(std::string key, std::string text)
+void Workspace::open_document(std::string key, std::string text, int version)
 {
-    m_documents[key] = text;
+    std::lock_guard<std::mutex> lock{m_mutex};
+    WorkspaceSnapshot& state = mutable_state();
+    state.m_open_documents.insert(key);
+    state.m_documents[std::move(key)] = Document(std::move(text), version);
 }
 
 bool Workspace::remove_document(std::string key)
 {
-    auto it = m_documents.find(key);
-    if (it != m_documents.end()) {
-        m_documents.erase(it);
+    std::lock_guard<std::mutex> lock{m_mutex};
+    WorkspaceSnapshot& state = mutable_state();
+    state.m_open_documents.erase(key);
+
+    auto includes = state.m_includes.find(key);
+    if (includes != state.m_includes.end()) {
+        for (const auto& include : includes->second) {
+            state.m_dependents[include].erase(key);
+        }
+        state.m_includes.erase(includes);
+    }
+
+    auto it = state.m_documents.find(key);
+    if (it != state.m_documents.end()) {
+        state.m_documents.erase(it);
         return true;
     }
     return false;
 }
 
-bool Workspace::change_document(std::string key, std::string text)
+bool Workspace::change_document(const std::string& key, std::string text, int version)
 {
-    auto it = m_documents.find(key);
-    if (it != m_documents.end()) {
-        m_documents[key] = text;
-        return true;
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (!m_state->m_documents.contains(key)) return false;
+
+    Document& document = mutable_state().m_documents.find(key)->second;
+    document.set_text(std::move(text));
+    document.set_version(version);
+    return true;
+}
+
+bool Workspace::change_document(const std::string& key, SourceFileLocation start, SourceFileLocation end,
+        std::string_view text, int version)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (!m_state->m_documents.contains(key)) return false;
+
+    Document& document = mutable_state().m_documents.find(key)->second;
+    document.replace(start, end, text);
+    document.set_version(version);
+    return true;
+}
+
+void Workspace::set_includes(const std::string& key, std::set<std::string> includes)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    // Most parses include the same files as the last one, which needs no copy.
+    auto current = m_state->m_includes.find(key);
+    if (current != m_state->m_includes.end() && current->second == includes) return;
+
+    WorkspaceSnapshot& state = mutable_state();
+    auto& old_includes = state.m_includes[key];
+    for (const auto& include : old_includes) {
+        if (!includes.contains(include)) {
+            state.m_dependents[include].erase(key);
+        }
     }
-    return false;
+    for (const auto& include : includes) {
+        state.m_dependents[include].insert(key);
+    }
+    old_includes = std::move(includes);
+}
+
+std::set<std::string> Workspace::includes(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_state->includes(key);
+}
+
+std::vector<std::string> Workspace::open_dependents(const std::string& key, size_t limit)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_state->open_dependents(key, limit);
 }
@@ -2,8 +2,41 @@
 #define WORKSPACE_H
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
+
+#include "document.hpp"
+
+/// The documents and include graph of a workspace at one point in time. A
+/// snapshot never changes, so it may be read from any thread without locking.
+class WorkspaceSnapshot
+{
+
+public:
+    std::optional<Document> get_document(const std::string& key) const;
+    /// Returns the files the document included in its most recent parse.
+    std::set<std::string> includes(const std::string& key) const;
+    /// Returns the open documents that include the given file, directly or
+    /// transitively, but at most `limit` of them.
+    std::vector<std::string> open_dependents(const std::string& key, size_t limit) const;
+
+private:
+    friend class Workspace;
+
+    std::map<std::string, Document> m_documents;
+    std::set<std::string> m_open_documents;
+
+    /// Maps each parsed document to everything it includes.
+    std::map<std::string, std::set<std::string>> m_includes;
+    /// The reverse of `m_includes`: maps each file to the documents including it.
+    std::map<std::string, std::set<std::string>> m_dependents;
+};
 
 class Workspace
 {
@@ -15,14 +48,40 @@ public:
     bool is_initialized();
     void set_initialized(bool new_value);
 
-    std::map<std::string, std::string>& documents();
-    void add_document(std::string key, std::string text);
+    /// Returns a snapshot of the document with the given uri, which stays
+    /// valid after later changes. The documents may be accessed from any thread.
+    std::optional<Document> get_document(const std::string& key);
+    void add_document(std::string key, std::string text, int version = 0);
+    /// Adds a document that is open in the client.
+    void open_document(std::string key, std::string text, int version);
+    /// Removes a document, including its place in the include graph.
     bool remove_document(std::string key);
-    bool change_document(std::string key, std::string text);
+    bool change_document(const std::string& key, std::string text, int version);
+    bool change_document(const std::string& key, SourceFileLocation start, SourceFileLocation end,
+            std::string_view text, int version);
+
+    /// Records the files a document includes, directly or transitively, as
+    /// found by the most recent parse of that document.
+    void set_includes(const std::string& key, std::set<std::string> includes);
+    /// Returns the files the document included in its most recent parse.
+    std::set<std::string> includes(const std::string& key);
+    /// Returns the open documents that include the given file, directly or
+    /// transitively, but at most `limit` of them.
+    std::vector<std::string> open_dependents(const std::string& key, size_t limit);
+
+    /// Returns the current state of the workspace, which later changes leave
+    /// untouched. Taking a snapshot is cheap; the first change while one is
+    /// held copies the maps, but not the document texts.
+    std::shared_ptr<const WorkspaceSnapshot> snapshot();
 
 private:
+    /// Returns the state for modification, after copying it if a snapshot of
+    /// it may still be in use. Must be called with the mutex held.
+    WorkspaceSnapshot& mutable_state();
+
     bool m_initialized = false;
-    std::map<std::string, std::string> m_documents;
+    std::mutex m_mutex;
+    std::shared_ptr<WorkspaceSnapshot> m_state;
 };
 
 #endif /* WORKSPACE_H */